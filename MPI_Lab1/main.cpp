@@ -1,5 +1,7 @@
 #include <mpich/mpi.h>
 #include <stdio.h>
+#include "../common/metrics.h"
+#include "../common/log.h"
 
 int main(int argc, char* argv[]) {
     int rank, size;
@@ -8,14 +10,12 @@ int main(int argc, char* argv[]) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank); 
     MPI_Comm_size(MPI_COMM_WORLD, &size); 
 
-    if (rank > 0)
-        MPI_Recv(NULL, 0, MPI_INT, rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-    printf("Hello world from process %d of %d\n", rank + 1, size);
-
-    if (rank < (size - 1))
-        MPI_Send(NULL, 0, MPI_INT, rank + 1, 0, MPI_COMM_WORLD);
+    //lines of all processes are printed in rank order by one gather
+    logger.Open(MPI_COMM_WORLD, logOrdered);
+    logger.Printf("Hello world from process %d of %d\n", rank + 1, size);
+    logger.Close();
 
+    metrics.Report("lab1", MPI_COMM_WORLD);
 
     MPI_Finalize();
     return 0;
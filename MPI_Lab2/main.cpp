@@ -4,148 +4,150 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <time.h>
-#include <iostream>
-#include <sstream> 
-
-//tags for send/receive
-
-enum Tags{
-	createArrayTag = 0,
-	shiftSizeTag = 1,
-	shiftTag = 2,
-	arraySizeTag = 3
+#include "../common/metrics.h"
+#include "../common/log.h"
+#include "rotate.h"
+
+//parameters of shift, process 0 sends them to all processes by one broadcast
+struct ShiftParams {
+	long totalSize; //elements of full array
+	long shiftSize; //any, negative shifts to the left
 };
 
-//func shifts elems
+//shifts block of process and prints it before and after shift
+void ShiftBlockFunc(int mpi_rank, int* array, const BlockLayout& layout, long shiftSize) {
+	long size = BlockSize(layout, mpi_rank);
 
-void ShiftArrayFunc(int sizePerProcess, int shiftSize, int* array, int* newElems) {
-	for (int i = sizePerProcess - 1; i >= shiftSize; i--) {
-		array[i] = array[i - shiftSize];
+	logger.Printf("\n==========================================================");
+	logger.Printf("\nProcess rank = %d", mpi_rank);
+	logger.Printf("\nBefore shift: ");
+	for (long i = 0; i < size; i++) {
+		logger.Printf("%d-", array[i]);
 	}
 
-	for (int i = 0; i < shiftSize; i++) {
-		array[i] = newElems[i];
-	}
-}
-
-void MainProcessFunc(int mpi_rank, int mpi_size) {
-	int sizePerProcess = 5;
-	int shiftSize = 3;
+	//shift elems of all processes
+	RotateDistributed(array, layout, shiftSize, MPI_COMM_WORLD);
 
-	printf("Processes count = %d\n", mpi_size);
-	printf("Array size per process = %d \nShift size = %d\n", sizePerProcess, shiftSize);
-
-	//create array
-	int* array = new int[mpi_size * sizePerProcess];
-
-	printf("Full array: ");
-	for (int i = 0; i < mpi_size * sizePerProcess; i++) {
-		array[i] = rand() % 100;
-		printf("%d-", array[i]);
-	}
-
-
-	//send array size
-	for (int i = 1; i < mpi_size; i++) {
-		MPI_Send(&sizePerProcess, 1, MPI_INT, i, arraySizeTag, MPI_COMM_WORLD);
+	logger.Printf("\nAfter shift: ");
+	for (long i = 0; i < size; i++) {
+		logger.Printf("%d-", array[i]);
 	}
+	
+	//blocks of all processes are printed in rank order
+	logger.Flush();
+}
 
-	//send array
-	for (int i = 1; i < mpi_size; i++) {
-		MPI_Send(&(array[(i - 1) * sizePerProcess]), sizePerProcess, MPI_INT, i, createArrayTag, MPI_COMM_WORLD);
+//process 0 makes full array and sends blocks to all processes (process 0 has block too),
+//after shift blocks are gathered back and checked with shift of full array
+void ShiftArrayFunc(int mpi_rank, int mpi_size, ShiftParams params) {
+	//same parameters on all processes
+	metrics.Start(phaseBroadcast);
+	MPI_Bcast(&params, sizeof (params), MPI_BYTE, 0, MPI_COMM_WORLD);
+	metrics.Stop(phaseBroadcast);
+	metrics.AddBytes(callBcast, sizeof (params));
+
+	BlockLayout layout;
+	layout.totalSize = params.totalSize;
+	layout.processes = mpi_size;
+	int* counts = new int[mpi_size];
+	int* displs = new int[mpi_size];
+	for (int i = 0; i < mpi_size; i++) {
+		counts[i] = BlockSize(layout, i);
+		displs[i] = BlockStart(layout, i);
 	}
 
-	//send shift array size
-	for (int i = 1; i < mpi_size; i++) {
-		MPI_Send(&shiftSize, 1, MPI_INT, i, shiftSizeTag, MPI_COMM_WORLD);
+	//create array
+	int* full = NULL;
+	if (mpi_rank == 0) {
+		printf("Processes count = %d\n", mpi_size);
+		printf("Array size = %ld \nShift size = %ld\n", params.totalSize, params.shiftSize);
+
+		full = new int[params.totalSize];
+		printf("Full array: ");
+		for (long i = 0; i < params.totalSize; i++) {
+			full[i] = rand() % 100;
+			printf("%d-", full[i]);
+		}
 	}
-	
-	MPI_Barrier(MPI_COMM_WORLD);
-}
 
-void SecondaryProcessesFunc(int mpi_rank, int mpi_size) {
-	//receive array size
-	int sizePerProcess;
-	MPI_Recv(&sizePerProcess, 1, MPI_INT, 0, arraySizeTag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	//blocks of array, sizes differ by one if array isn't divisible
+	int* array = new int[counts[mpi_rank] + 1];
+	metrics.Start(phaseScatter);
+	MPI_Scatterv(full, counts, displs, MPI_INT, array, counts[mpi_rank], MPI_INT, 0, MPI_COMM_WORLD);
+	metrics.Stop(phaseScatter);
+	metrics.AddBytes(callScatter, counts[mpi_rank] * sizeof (int));
 
-	//receive part of array
-	int* array = new int[sizePerProcess];
-	MPI_Recv(array, sizePerProcess, MPI_INT, 0, createArrayTag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	ShiftBlockFunc(mpi_rank, array, layout, params.shiftSize);
 
-	//receive shift size
-	int shiftSize;
-	MPI_Recv(&shiftSize, 1, MPI_INT, 0, shiftSizeTag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-	
-	//last process sends shift elems 
-	if (mpi_rank == (mpi_size - 1))
-	MPI_Send(&(array[sizePerProcess - shiftSize]), shiftSize, MPI_INT, 1, shiftTag, MPI_COMM_WORLD);
-	//all processes except last send shift elems to next process
-	else 
-	MPI_Send(&(array[sizePerProcess - shiftSize]), shiftSize, MPI_INT, mpi_rank + 1, shiftTag, MPI_COMM_WORLD);
-
-	//processes receive shift elems from previous process
-	int* newElements = new int[shiftSize];
-	if (mpi_rank == 1)
-	MPI_Recv(newElements, sizePerProcess, MPI_INT, mpi_size - 1, shiftTag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	else
-	MPI_Recv(newElements, sizePerProcess, MPI_INT, mpi_rank - 1, shiftTag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	//shifted array
+	int* shifted = (mpi_rank == 0) ? new int[params.totalSize] : NULL;
+	metrics.Start(phaseGather);
+	MPI_Gatherv(array, counts[mpi_rank], MPI_INT, shifted, counts, displs, MPI_INT, 0, MPI_COMM_WORLD);
+	metrics.Stop(phaseGather);
+	metrics.AddBytes(callGather, counts[mpi_rank] * sizeof (int));
 
-	
-	
-	std::stringstream ss;
-	ss << "\n==========================================================";
-	ss << "\nProcess rank = " << mpi_rank;
-	ss << "\nBefore shift: ";
-	for (int i = 0; i < sizePerProcess; i++) {
-		ss << array[i] << "-";
+	if (mpi_rank == 0) {
+		long shift = (params.totalSize > 0) ? ((params.shiftSize % params.totalSize) + params.totalSize) % params.totalSize : 0;
+		bool equal = true;
+		printf("\nShifted array: ");
+		for (long i = 0; i < params.totalSize; i++) {
+			printf("%d-", shifted[i]);
+			if (shifted[i] != full[(i - shift + params.totalSize) % params.totalSize]) equal = false;
+		}
+		printf("\nCheck: %s\n", equal ? "ok" : "failed");
 	}
 
-	//shift elems
-	ShiftArrayFunc(sizePerProcess, shiftSize, array, newElements);
-	
-
-	ss << "\nAfter shift: ";
-	for (int i = 0; i < sizePerProcess; i++) {
-		ss << array[i] << "-";
-	}
-	
-	MPI_Barrier(MPI_COMM_WORLD);
-	usleep(mpi_rank*100);
-	std::cout << ss.str();
+	delete[] full;
+	delete[] shifted;
+	delete[] array;
+	delete[] counts;
+	delete[] displs;
 }
 
 int main(int argc, char* argv[]) {
 
-	clock_t tStart = clock();
-
 	int mpi_rank, mpi_size;
 
 	MPI_Init(&argc, &argv);
+	double tStart = MPI_Wtime();
 	MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
 
-	if (mpi_size < 3)
-	return 0;
+	ShiftParams params;
+	params.totalSize = 5 * mpi_size;
+	params.shiftSize = 3;
+
+	int option;
+	opterr = mpi_rank == 0; //errors of options are printed once
+	while ((option = getopt(argc, argv, "n:N:s:")) != -1) {
+		switch (option) {
+			case 'n': params.totalSize = atol(optarg) * mpi_size;
+				break;
+			case 'N': params.totalSize = atol(optarg);
+				break;
+			case 's': params.shiftSize = atol(optarg);
+				break;
+			default:
+				if (mpi_rank == 0) printf("\nUsage: mpi_lab2 [-n sizePerProcess | -N arraySize] [-s shiftSize]\n");
+				MPI_Finalize();
+				return 0;
+		}
+	}
 	
 	srand(time(NULL)+mpi_rank);
 
-	//main process
-	if (mpi_rank == 0) {
-		MainProcessFunc(mpi_rank, mpi_size);
-	}
-	//other processes
-	else {
-		SecondaryProcessesFunc(mpi_rank, mpi_size);
-	}
+	//parameters of process 0 are used
+	logger.Open(MPI_COMM_WORLD, logOrdered);
+	ShiftArrayFunc(mpi_rank, mpi_size, params);
+	logger.Close();
 
-	MPI_Finalize();
-	
-	
 	if (mpi_rank==0) {
-		printf("Time taken: %.2fs\n", (double)(clock() - tStart)/CLOCKS_PER_SEC);
+		printf("Time taken: %.2fs\n", MPI_Wtime() - tStart);
 	}
 
+	metrics.Report("lab2", MPI_COMM_WORLD);
+	MPI_Finalize();
+
 
 	return 0;
 }
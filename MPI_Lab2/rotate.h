@@ -0,0 +1,147 @@
+#ifndef ROTATE_H
+#define ROTATE_H
+
+#include <mpi.h>
+#include <string.h>
+#include <algorithm>
+#include "../common/metrics.h"
+
+//cyclic shift (rotation to the right) of distributed array of int by any count of elements
+//array of totalSize elements is divided to blocks of all processes:
+//first totalSize % mpi_size processes have one element more (balanced layout)
+//element with global index g goes to (g + shift) % totalSize, so shifted block of process covers
+//end of one block and beginning of next one: for blocks of size b block goes shift / b processes further
+//and its last shift % b elements go one process more
+//every process sends and receives at most two pieces without blocking, piece which stays on process
+//is moved in place, so cost doesn't depend on shift
+
+const int rotatePieces = 2; //max pieces of block in balanced layout
+
+struct BlockLayout {
+	long totalSize;
+	int processes;
+};
+
+static long BlockStart(const BlockLayout& layout, int rank) {
+	long base = layout.totalSize / layout.processes;
+	long extra = layout.totalSize % layout.processes;
+	return rank * base + ((rank < extra) ? rank : extra);
+}
+
+static long BlockSize(const BlockLayout& layout, int rank) {
+	return BlockStart(layout, rank + 1) - BlockStart(layout, rank);
+}
+
+//process which has element with global index
+static int BlockOwner(const BlockLayout& layout, long index) {
+	long base = layout.totalSize / layout.processes;
+	long extra = layout.totalSize % layout.processes;
+	if (index < extra * (base + 1)) return index / (base + 1);
+	return extra + (index - extra * (base + 1)) / base;
+}
+
+//piece of block: count elements at offset of this process and offset of other process
+struct RotatePiece {
+	int rank;
+	long offset, otherOffset, count;
+};
+
+//divides global range [start, start + count) (cyclic) to pieces of blocks of processes
+static int SplitRange(const BlockLayout& layout, long start, long count, RotatePiece* pieces) {
+	int n = 0;
+	long offset = 0;
+	long position = start % layout.totalSize;
+	while (offset < count) {
+		int rank = BlockOwner(layout, position);
+		long end = BlockStart(layout, rank) + BlockSize(layout, rank);
+		long length = (end - position < count - offset) ? end - position : count - offset;
+
+		pieces[n].rank = rank;
+		pieces[n].offset = offset;
+		pieces[n].otherOffset = position - BlockStart(layout, rank);
+		pieces[n].count = length;
+		n++;
+
+		offset += length;
+		position = (position + length) % layout.totalSize;
+	}
+	return n;
+}
+
+//rotates distributed array, array is block of this process in balanced layout (collective)
+static void RotateDistributed(int* array, const BlockLayout& layout, long shift, MPI_Comm comm) {
+	int mpi_rank;
+	MPI_Comm_rank(comm, &mpi_rank);
+	if (layout.totalSize == 0) return;
+
+	long size = BlockSize(layout, mpi_rank);
+	long start = BlockStart(layout, mpi_rank);
+	shift = ((shift % layout.totalSize) + layout.totalSize) % layout.totalSize;
+
+	//only one process has elements, it rotates them itself
+	if (size == layout.totalSize) {
+		metrics.Start(phaseCompute);
+		std::rotate(array, array + size - shift, array + size);
+		metrics.Stop(phaseCompute);
+		return;
+	}
+
+	//where elements of this block go and where elements of new block come from
+	RotatePiece sends[rotatePieces], receives[rotatePieces];
+	int sendCount = SplitRange(layout, start + shift, size, sends);
+	int receiveCount = SplitRange(layout, start + layout.totalSize - shift, size, receives);
+
+	//remote pieces are packed, because array is changed by local piece before sending is done
+	long remote = 0;
+	for (int i = 0; i < sendCount; i++) {
+		if (sends[i].rank != mpi_rank) remote += sends[i].count;
+	}
+	int* sendBuffer = new int[remote + 1];
+	int* receiveBuffer = new int[remote + 1];
+	MPI_Request requests[2 * rotatePieces];
+	int requestCount = 0;
+
+	metrics.Start(phaseShift);
+	long packed = 0;
+	for (int i = 0; i < receiveCount; i++) {
+		if (receives[i].rank == mpi_rank) continue;
+		MPI_Irecv(&(receiveBuffer[packed]), receives[i].count, MPI_INT, receives[i].rank, 0, comm, &(requests[requestCount++]));
+		packed += receives[i].count;
+	}
+	packed = 0;
+	for (int i = 0; i < sendCount; i++) {
+		if (sends[i].rank == mpi_rank) continue;
+		memcpy(&(sendBuffer[packed]), &(array[sends[i].offset]), sends[i].count * sizeof (int));
+		MPI_Isend(&(sendBuffer[packed]), sends[i].count, MPI_INT, sends[i].rank, 0, comm, &(requests[requestCount++]));
+		packed += sends[i].count;
+	}
+	metrics.Stop(phaseShift);
+	metrics.AddBytes(callSend, remote * sizeof (int));
+	metrics.AddBytes(callRecv, remote * sizeof (int));
+
+	//piece which stays on this process
+	metrics.Start(phaseCompute);
+	for (int i = 0; i < sendCount; i++) {
+		if (sends[i].rank == mpi_rank) {
+			memmove(&(array[sends[i].otherOffset]), &(array[sends[i].offset]), sends[i].count * sizeof (int));
+		}
+	}
+	metrics.Stop(phaseCompute);
+
+	metrics.Start(phaseShift);
+	MPI_Waitall(requestCount, requests, MPI_STATUSES_IGNORE);
+	metrics.Stop(phaseShift);
+
+	//received pieces are put to their places
+	packed = 0;
+	for (int i = 0; i < receiveCount; i++) {
+		if (receives[i].rank == mpi_rank) continue;
+		memcpy(&(array[receives[i].offset]), &(receiveBuffer[packed]), receives[i].count * sizeof (int));
+		packed += receives[i].count;
+	}
+
+	delete[] sendBuffer;
+	delete[] receiveBuffer;
+}
+
+#endif /* ROTATE_H */
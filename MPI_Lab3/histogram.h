@@ -0,0 +1,72 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <mpi.h>
+#include <string.h>
+
+//histogram of latencies in nanoseconds with log-linear buckets (as HdrHistogram):
+//values below 2 * histogramSub have own buckets, every next power of 2 is divided to histogramSub buckets,
+//so error of value is not more than 1 / histogramSub (1.6%) for any value
+//histograms of processes are merged by summing buckets
+
+const int histogramSubBits = 6;
+const int histogramSub = 1 << histogramSubBits;
+const int histogramBuckets = (64 - histogramSubBits + 1) * histogramSub;
+
+struct Histogram {
+	long counts[histogramBuckets];
+	long total;
+	long max;
+	double sum;
+};
+
+static void InitHistogram(Histogram& histogram) {
+	memset(histogram.counts, 0, sizeof (histogram.counts));
+	histogram.total = 0;
+	histogram.max = 0;
+	histogram.sum = 0;
+}
+
+static int HistogramBucket(long value) {
+	if (value < 2 * histogramSub) return (value > 0) ? value : 0;
+	int exponent = 63 - __builtin_clzl(value) - histogramSubBits; //value >> exponent is in [sub, 2 * sub)
+	return (exponent + 1) * histogramSub + (int) (value >> exponent) - histogramSub;
+}
+
+//lowest value of bucket
+static long HistogramValue(int bucket) {
+	if (bucket < 2 * histogramSub) return bucket;
+	int exponent = bucket / histogramSub - 1;
+	return (long) (bucket % histogramSub + histogramSub) << exponent;
+}
+
+static void RecordValue(Histogram& histogram, long value) {
+	histogram.counts[HistogramBucket(value)]++;
+	histogram.total++;
+	histogram.sum += value;
+	if (value > histogram.max) histogram.max = value;
+}
+
+//value not bigger than part of recorded values (0 < part <= 1)
+static long HistogramPercentile(const Histogram& histogram, double part) {
+	if (histogram.total == 0) return 0;
+
+	long needed = (long) (part * histogram.total + 0.5);
+	if (needed < 1) needed = 1;
+	long count = 0;
+	for (int bucket = 0; bucket < histogramBuckets; bucket++) {
+		count += histogram.counts[bucket];
+		if (count >= needed) return HistogramValue(bucket);
+	}
+	return histogram.max;
+}
+
+//sum of histograms of all processes on process root (collective)
+static void MergeHistograms(const Histogram& local, Histogram& merged, int root, MPI_Comm comm) {
+	MPI_Reduce(local.counts, merged.counts, histogramBuckets, MPI_LONG, MPI_SUM, root, comm);
+	MPI_Reduce(&(local.total), &(merged.total), 1, MPI_LONG, MPI_SUM, root, comm);
+	MPI_Reduce(&(local.max), &(merged.max), 1, MPI_LONG, MPI_MAX, root, comm);
+	MPI_Reduce(&(local.sum), &(merged.sum), 1, MPI_DOUBLE, MPI_SUM, root, comm);
+}
+
+#endif /* HISTOGRAM_H */
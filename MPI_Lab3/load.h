@@ -0,0 +1,77 @@
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//load of workers
+//  open loop   - new messages are made by timers at mean interval, whether confirmations came or not
+//  closed loop - every worker keeps window messages without confirmation, new message is sent
+//                when confirmation comes
+//length of data of message has one of distributions from 2 to maxData bytes (with terminating zero)
+
+enum LoadModes {
+	loadOpen,
+	loadClosed
+};
+
+enum PayloadDistributions {
+	payloadUniform,
+	payloadFixed, //always maxData
+	payloadExponential //mean is maxData / 4, small messages are often
+};
+
+struct LoadOptions {
+	LoadModes mode;
+	double interval; //seconds, mean time between new messages of worker in open loop, 0 - from 2 to 2*workers seconds
+	int window; //messages without confirmation in closed loop
+	PayloadDistributions payload;
+	double duration; //seconds of making new messages, 0 - forever
+	bool benchmark; //don't print messages, report latencies and throughput at the end
+};
+
+static void InitLoadOptions(LoadOptions& load) {
+	load.mode = loadOpen;
+	load.interval = 0;
+	load.window = 1;
+	load.payload = payloadUniform;
+	load.duration = 0;
+	load.benchmark = false;
+}
+
+static PayloadDistributions ParsePayload(const char* name) {
+	if (strcmp(name, "fixed") == 0) return payloadFixed;
+	if (strcmp(name, "exponential") == 0) return payloadExponential;
+	return payloadUniform;
+}
+
+static const char* PayloadName(PayloadDistributions payload) {
+	if (payload == payloadFixed) return "fixed";
+	if (payload == payloadExponential) return "exponential";
+	return "uniform";
+}
+
+//delay before next new message of worker in open loop
+static double NextMessageDelay(const LoadOptions& load, int workers) {
+	double r = (double) rand() / RAND_MAX;
+	//by default from 2 to 2*workers seconds, else from 0.5 to 1.5 of interval
+	if (load.interval <= 0) return 2 + 2 * (workers - 1) * r;
+	return load.interval * (0.5 + r);
+}
+
+//length of data of new message
+static int NextPayloadLength(const LoadOptions& load, int maxData) {
+	int length;
+	if (load.payload == payloadFixed) {
+		length = maxData;
+	} else if (load.payload == payloadExponential) {
+		double r = (rand() + 1.0) / (RAND_MAX + 1.0);
+		length = 2 + (int) (-log(r) * maxData / 4);
+	} else {
+		length = rand() % (maxData - 1) + 2;
+	}
+	return (length < maxData) ? length : maxData;
+}
+
+#endif /* LOAD_H */
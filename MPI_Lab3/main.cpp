@@ -5,161 +5,430 @@
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
+#include <utility>
+#include "../common/metrics.h"
+#include "../common/log.h"
+#include "message.h"
+#include "router.h"
+#include "timer.h"
+#include "load.h"
+#include "histogram.h"
 
 
-typedef uint8_t byte;
-
 //tags for messages
 enum MPI_Tags {
 	messageTag = 0,
 	confirmTag = 1
 };
 
-void MainProcessFunc(int mpi_rank, int mpi_size) {
+//events of timers of worker
+enum WorkerEvents {
+	eventNewMessage = 0
+};
+
+const int workerSlots = 8; //messages which worker can receive at once
+const double workerPoll = 0.00005; //seconds, max sleep of worker while timer is pending, MPI has no wait for message with timeout
+const int latencyWindow = 1 << 16; //send times of messages without confirmation, by ID
+
+//termination: worker stops making new messages after duration, waits for confirmations of its messages
+//and enters MPI_Ibarrier, but still receives messages and sends confirmations until barrier is done
+//relay and routers enter barrier at once and forward messages until barrier is done
+//when all workers have confirmations of all their messages, no message is in flight,
+//so after barrier posted receives are cancelled and processes finish
+
+void MainProcessFunc(int mpi_rank, int mpi_size, const MessageTypes& types) {
 
 	MPI_Status status;
-	int count;
-	byte* message = new byte;
-	int destination;
+	MessagePool pool;
+	InitMessagePool(pool, 1, types.maxData);
+	MessageBuffer message(pool);
+	RouterStats stats;
+	InitRouterStats(stats);
 
 	printf("Processes count = %d\n", mpi_size);
 
+	//receive and barrier
+	MPI_Request requests[2];
+	MPI_Irecv(message.Bytes(), 1, types.messages[types.maxData], MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &(requests[0]));
+	MPI_Ibarrier(MPI_COMM_WORLD, &(requests[1]));
+
 	while (true) {
-		//wait for message
-		MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-		MPI_Get_count(&status, MPI_BYTE, &count);
+		//wait for message, message with any length fits in buffer
+		int index;
+		metrics.Start(phaseReceive);
+		MPI_Waitany(2, requests, &index, &status);
+		metrics.Stop(phaseReceive);
+		if (index == 1) break;
+
+		MessageHeader* header = message.Header();
+		int count = sizeof (MessageHeader) + header->length;
+		metrics.AddBytes(callRecv, count);
+		RouterReceived(stats);
+		
+		//resend message
+		metrics.Start(phaseSend);
+		MPI_Send(message.Bytes(), 1, types.messages[header->length], header->destination, status.MPI_TAG, MPI_COMM_WORLD);
+		metrics.Stop(phaseSend);
+		metrics.AddBytes(callSend, count);
+		RouterForwarded(stats, count);
+
+		ReportRouterStats(stats, mpi_rank);
+		MPI_Irecv(message.Bytes(), 1, types.messages[types.maxData], MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &(requests[0]));
+	}
 
-		delete message;
-		message = new byte[count];
+	MPI_Cancel(&(requests[0]));
+	MPI_Wait(&(requests[0]), MPI_STATUS_IGNORE);
 
-		//resend message
-		MPI_Recv(message, count, MPI_BYTE, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-		memcpy(&destination, &(message[4]), 4);
-		
-		MPI_Send(message, count, MPI_BYTE, destination, status.MPI_TAG, MPI_COMM_WORLD);
+	//buffers are returned before pool is freed
+	message.Release();
+	FreeMessagePool(pool);
+}
+
+//messages which are being sent, their buffers are kept until sending is done
+struct SendQueue {
+	MessageBuffer messages[workerSlots];
+	MPI_Request requests[workerSlots];
+};
 
+static void InitSendQueue(SendQueue& queue) {
+	for (int i = 0; i < workerSlots; i++) {
+		queue.requests[i] = MPI_REQUEST_NULL;
 	}
+}
 
+//returns buffers of sent messages to pool
+static void CompleteSends(SendQueue& queue) {
+	int done;
+	int indices[workerSlots];
+	MPI_Testsome(workerSlots, queue.requests, &done, indices, MPI_STATUSES_IGNORE);
+	for (int d = 0; d < done; d++) {
+		queue.messages[indices[d]].Release();
+	}
 }
 
-void SecondaryProcessesFunc(int mpi_rank, int mpi_size) {
+//starts sending, waits only if all slots of queue are sending
+static void SendMessage(SendQueue& queue, MessageBuffer&& message, int process, int tag, const MessageTypes& types) {
+	int slot = 0;
+	while (slot < workerSlots && queue.requests[slot] != MPI_REQUEST_NULL) slot++;
+	if (slot == workerSlots) {
+		MPI_Waitany(workerSlots, queue.requests, &slot, MPI_STATUS_IGNORE);
+	}
 
-	MPI_Status status;
-	int flag;
-	time_t prevTime;
-	int dTime;
-	int count;
-	byte* message = new byte;
-	int source, destination;
-	byte* responseMessage = new byte;
-	int messageID = mpi_rank*100;
-	int receivMessID;
+	queue.messages[slot] = std::move(message);
+	int length = queue.messages[slot].Header()->length;
+	metrics.Start(phaseSend);
+	MPI_Isend(queue.messages[slot].Bytes(), 1, types.messages[length], process, tag, MPI_COMM_WORLD, &(queue.requests[slot]));
+	metrics.Stop(phaseSend);
+	metrics.AddBytes(callSend, sizeof (MessageHeader) + length);
+}
 
-	while (true) {
-		
-		prevTime = time(NULL);
-		dTime = rand() % mpi_size * 2 + 2;
-		
-		//wait some time for message
-		while (time(NULL)<(prevTime + dTime)) {
-			MPI_Iprobe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
-
-			//if there is message
-			if (flag) {
-				MPI_Get_count(&status, MPI_BYTE, &count);
-
-				delete message;
-				message = new byte[count];
-
-				//receive message
-				MPI_Recv(message, count, MPI_BYTE, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-				memcpy(&source, &(message[0]), 4);
-				memcpy(&receivMessID, &(message[8]), 4);
-
-				//if message with data - send confirmation
-				if (status.MPI_TAG == messageTag) {
-					printf("[%d] received message from [%d]. ID: %d. Data: %s\n", mpi_rank, source, receivMessID, &(message[12]));
-					
-					delete responseMessage;
-					responseMessage = new byte[12];
-					
-					memcpy(responseMessage, &mpi_rank, 4);
-					memcpy(&(responseMessage[4]), &source, 4);
-					memcpy(&(responseMessage[8]), &receivMessID, 4);
-					
-					MPI_Send(responseMessage, 12, MPI_BYTE, 0, confirmTag, MPI_COMM_WORLD);
-					//if confirmation - print to screen
-				} else if (status.MPI_TAG == confirmTag) {
-					printf("[%d] received confirmation from [%d]. ID: %d\n", mpi_rank, source, receivMessID);
-				}
-
-				flag = 0;
-			}
+//state of worker
+struct Worker {
+	int mpi_rank, mpi_size;
+	int firstWorker, workers;
+	int messageID;
+	long outstanding; //sent messages without confirmation
+	double* sendTimes; //by ID % latencyWindow
+	MessagePool pool;
+	SendQueue sendQueue;
+};
+
+//makes and sends new random message
+static void SendNewMessage(Worker& worker, const Routing& routing, const LoadOptions& load, const MessageTypes& types) {
+	worker.messageID++;
+	MessageBuffer message(worker.pool);
+	MessageHeader* header = message.Header();
+	//random length
+	header->length = NextPayloadLength(load, types.maxData);
+	
+	//random data
+	char* data = message.Data();
+	for (int i = 0; i < header->length - 1; i++) {
+		data[i] = rand() % 25 + 65;
+	}
+	data[header->length - 1] = '\0';
+
+	//random destination
+	int destination = worker.mpi_rank;
+	for (; destination == worker.mpi_rank;) {
+		destination = rand() % worker.workers + worker.firstWorker;
+	}
+
+	//send message
+	header->source = worker.mpi_rank;
+	header->destination = destination;
+	header->id = worker.messageID;
+
+	if (!load.benchmark) logger.Printf("[%d] sent message to [%d]. ID: %d. Data: %s\n", worker.mpi_rank, destination, worker.messageID, data);
+
+	worker.sendTimes[worker.messageID % latencyWindow] = MPI_Wtime();
+	worker.outstanding++;
+	SendMessage(worker.sendQueue, std::move(message), NextHop(routing, destination, worker.mpi_size), messageTag, types);
+}
+
+//worker is event-driven: receives are posted for workerSlots messages,
+//new messages are sent by timers (open loop) or after confirmations (closed loop)
+//without pending timers worker blocks in MPI_Waitsome for messages or barrier of termination
+//(a confirmation will come while worker has messages without confirmation)
+//while timer is pending, MPI can't wait for message with timeout, so worker sleeps until timer
+//by slices of at most poll seconds (bounded sleep: delivery may wait up to poll in open loop)
+//all messages are in buffers of pool: received, being sent and one which is being made
+//latencies (from sending to confirmation) are recorded to histogram,
+//elapsed is time until confirmations of all messages came
+void SecondaryProcessesFunc(int mpi_rank, int mpi_size, const Routing& routing, const LoadOptions& load, double poll,
+		const MessageTypes& types, Histogram& latency, double& elapsed) {
+
+	Worker worker;
+	worker.mpi_rank = mpi_rank;
+	worker.mpi_size = mpi_size;
+	worker.firstWorker = FirstWorker(routing);
+	worker.workers = mpi_size - worker.firstWorker;
+	worker.messageID = mpi_rank*100;
+	worker.outstanding = 0;
+	worker.sendTimes = new double[latencyWindow];
+	InitMessagePool(worker.pool, 2 * workerSlots + 1, types.maxData);
+	InitSendQueue(worker.sendQueue);
+
+	//posted receives
+	MessageBuffer* received = new MessageBuffer[workerSlots];
+	MPI_Request* requests = new MPI_Request[workerSlots + 1]; //last is barrier of termination
+	int* indices = new int[workerSlots + 1];
+	MPI_Status* statuses = new MPI_Status[workerSlots + 1];
+	for (int i = 0; i < workerSlots; i++) {
+		received[i] = MessageBuffer(worker.pool);
+		MPI_Irecv(received[i].Bytes(), 1, types.messages[types.maxData], MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &(requests[i]));
+	}
 
+	double tStart = MPI_Wtime();
+	bool generating = true;
+	bool barrierStarted = false, finished = false;
+	requests[workerSlots] = MPI_REQUEST_NULL;
+
+	TimerWheel wheel;
+	InitTimerWheel(wheel, tStart);
+	int events[timerCapacity];
+	if (load.mode == loadOpen) {
+		ScheduleTimer(wheel, tStart + NextMessageDelay(load, worker.workers), eventNewMessage);
+	} else {
+		for (int i = 0; i < load.window; i++) {
+			SendNewMessage(worker, routing, load, types);
 		}
+	}
 
-		//create new random message after waiting for some time
-		messageID++;
-		delete message;
-		//random length
-		count = rand() % 10 + 14;
-		message = new byte[count];
-		
-		//random data
-		for (int i = 12; i < count - 1; i++) {
-			message[i] = rand() % 25 + 65;
+	while (!finished) {
+
+		CompleteSends(worker.sendQueue);
+
+		//received messages, worker waits for them if nothing else can happen before
+		bool block = NextTimerDelay(wheel, MPI_Wtime()) < 0 && (worker.outstanding > 0 || barrierStarted);
+		int done;
+		metrics.Start(phaseReceive);
+		if (block) {
+			MPI_Waitsome(workerSlots + 1, requests, &done, indices, statuses);
+		} else {
+			MPI_Testsome(workerSlots + 1, requests, &done, indices, statuses);
 		}
-		message[count - 1] = '\0';
+		metrics.Stop(phaseReceive);
+		if (done == MPI_UNDEFINED) done = 0;
 
-		//random destination
-		destination = mpi_rank;
-		for (; destination == mpi_rank;) {
-			destination = rand() % (mpi_size - 1) + 1;
+		for (int d = 0; d < done; d++) {
+			if (indices[d] == workerSlots) {
+				finished = true;
+				continue;
+			}
+			MessageHeader* header = received[indices[d]].Header();
+			metrics.AddBytes(callRecv, sizeof (MessageHeader) + header->length);
+
+			//if message with data - send confirmation
+			if (statuses[d].MPI_TAG == messageTag) {
+				if (!load.benchmark) logger.Printf("[%d] received message from [%d]. ID: %d. Data: %s\n", mpi_rank, header->source, header->id, received[indices[d]].Data());
+
+				MessageBuffer response(worker.pool);
+				response.Header()->source = mpi_rank;
+				response.Header()->destination = header->source;
+				response.Header()->id = header->id;
+				response.Header()->length = 0;
+				SendMessage(worker.sendQueue, std::move(response), NextHop(routing, header->source, mpi_size), confirmTag, types);
+				//if confirmation - print to screen
+			} else if (statuses[d].MPI_TAG == confirmTag) {
+				if (!load.benchmark) logger.Printf("[%d] received confirmation from [%d]. ID: %d\n", mpi_rank, header->source, header->id);
+
+				RecordValue(latency, (long) ((MPI_Wtime() - worker.sendTimes[header->id % latencyWindow]) * 1e9));
+				worker.outstanding--;
+				if (load.mode == loadClosed && generating) SendNewMessage(worker, routing, load, types);
+			}
+
+			//buffer is free for next message
+			MPI_Irecv(received[indices[d]].Bytes(), 1, types.messages[types.maxData], MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &(requests[indices[d]]));
 		}
 
-		//send message
-		memcpy(message, &mpi_rank, 4);
-		memcpy(&(message[4]), &destination, 4);
-		memcpy(&(message[8]), &messageID, 4);
+		//expired timers
+		int fired = ExpireTimers(wheel, MPI_Wtime(), events, timerCapacity);
+		for (int e = 0; e < fired; e++) {
+			if (events[e] != eventNewMessage || !generating) continue;
+
+			SendNewMessage(worker, routing, load, types);
+			ScheduleTimer(wheel, MPI_Wtime() + NextMessageDelay(load, worker.workers), eventNewMessage);
+		}
 
-		printf("[%d] sent message to [%d]. ID: %d. Data: %s\n", mpi_rank, destination, messageID, &(message[12]));
+		//termination
+		if (generating && load.duration > 0 && MPI_Wtime() - tStart >= load.duration) generating = false;
+		if (!generating && worker.outstanding == 0 && !barrierStarted) {
+			elapsed = MPI_Wtime() - tStart;
+			MPI_Ibarrier(MPI_COMM_WORLD, &(requests[workerSlots]));
+			barrierStarted = true;
+		}
 
-		MPI_Send(message, count, MPI_BYTE, 0, messageTag, MPI_COMM_WORLD);
+		//nothing to do before timer - sleep until it, but not longer than poll to see new messages
+		if (!block && !finished && done == 0 && fired == 0 && poll > 0) {
+			double delay = NextTimerDelay(wheel, MPI_Wtime());
+			if (delay < 0 || delay > poll) delay = poll;
+			if (delay > 0) usleep((useconds_t) (delay * 1e6));
+		}
+	}
 
+	//all messages are delivered, posted receives aren't needed
+	for (int i = 0; i < workerSlots; i++) {
+		MPI_Cancel(&(requests[i]));
 	}
+	MPI_Waitall(workerSlots, requests, MPI_STATUSES_IGNORE);
+	MPI_Waitall(workerSlots, worker.sendQueue.requests, MPI_STATUSES_IGNORE);
 
+	//buffers are returned before pool is freed
+	delete[] received;
+	for (int i = 0; i < workerSlots; i++) {
+		worker.sendQueue.messages[i].Release();
+	}
+	FreeMessagePool(worker.pool);
+	delete[] worker.sendTimes;
+	delete[] requests;
+	delete[] indices;
+	delete[] statuses;
 }
 
+//merges latencies of all workers and prints them on process 0 (collective)
+void ReportBenchmark(int mpi_rank, int mpi_size, const Routing& routing, const LoadOptions& load, int maxData,
+		const Histogram& latency, double elapsed) {
+	Histogram* merged = new Histogram;
+	InitHistogram(*merged);
+	MergeHistograms(latency, *merged, 0, MPI_COMM_WORLD);
+	double slowest = 0;
+	MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
-int main(int argc, char* argv[]) {
+	if (mpi_rank == 0) {
+		const char* modes[] = {"relay", "direct", "hierarchical"};
+		printf("\nBenchmark: program=lab3 variant=%s routers=%d processes=%d load=%s window=%d interval=%.6f payload=%s maxdata=%d"
+				" messages=%ld elapsed=%.6f msgs=%.1f p50us=%.1f p99us=%.1f p999us=%.1f maxus=%.1f meanus=%.1f\n",
+				modes[routing.mode], routing.routers, mpi_size, (load.mode == loadClosed) ? "closed" : "open", load.window,
+				load.interval, PayloadName(load.payload), maxData, merged->total, slowest,
+				(slowest > 0) ? merged->total / slowest : 0.0,
+				HistogramPercentile(*merged, 0.5) / 1e3, HistogramPercentile(*merged, 0.99) / 1e3,
+				HistogramPercentile(*merged, 0.999) / 1e3, merged->max / 1e3,
+				(merged->total > 0) ? merged->sum / merged->total / 1e3 : 0.0);
+	}
+	delete merged;
+}
 
-	clock_t tStart = clock();
+
+int main(int argc, char* argv[]) {
 
 	int mpi_rank, mpi_size;
 
 	MPI_Init(&argc, &argv);
+	double tStart = MPI_Wtime();
 	MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
 
-	//if not enough processes
-	if (mpi_size < 3)
-	return 0;
+	RoutingModes mode = routingRelay;
+	int routers = 0;
+	int maxData = 11; //max bytes of data in message
+	double poll = workerPoll;
+	LoadOptions load;
+	InitLoadOptions(load);
+
+	int option;
+	opterr = mpi_rank == 0; //errors of options are printed once
+	while ((option = getopt(argc, argv, "m:R:i:s:d:bL:w:p:P:")) != -1) {
+		switch (option) {
+			case 'm':
+				if (strcmp(optarg, "direct") == 0) mode = routingDirect;
+				else if (strcmp(optarg, "hierarchical") == 0) mode = routingHierarchical;
+				else mode = routingRelay;
+				break;
+			case 'R': routers = atoi(optarg);
+				break;
+			case 'i': load.interval = atof(optarg) / 1000;
+				break;
+			case 's': maxData = atoi(optarg);
+				if (maxData < 2) maxData = 2;
+				break;
+			case 'd': load.duration = atof(optarg);
+				break;
+			case 'b': load.benchmark = true;
+				break;
+			case 'L': load.mode = (strcmp(optarg, "closed") == 0) ? loadClosed : loadOpen;
+				break;
+			case 'w': load.window = atoi(optarg);
+				if (load.window < 1) load.window = 1;
+				break;
+			case 'p': load.payload = ParsePayload(optarg);
+				break;
+			case 'P': poll = atof(optarg) / 1e6;
+				break;
+			default:
+				if (mpi_rank == 0) printf("\nUsage: mpi_lab3 [-m relay|direct|hierarchical] [-R routers] [-i intervalMs] [-s maxDataSize]"
+						" [-d seconds] [-b] [-L open|closed] [-w window] [-p uniform|fixed|exponential] [-P pollUs]\n");
+				MPI_Finalize();
+				return 0;
+		}
+	}
+
+	Routing routing;
+	InitRouting(routing, mode, routers);
+
+	//benchmark must finish
+	if (load.benchmark && load.duration <= 0) load.duration = 10;
+
+	//if not enough processes (at least 2 workers)
+	if (mpi_size - FirstWorker(routing) < 2) {
+		if (mpi_rank == 0) printf("Not enough processes: %d routers and at least 2 workers are needed\n", FirstWorker(routing));
+		MPI_Finalize();
+		return 0;
+	}
 
 	srand(time(NULL)+mpi_rank*10);
+
+	//messages are printed in hot loops, so records are written by big chunks without ordering
+	logger.Open(MPI_COMM_WORLD, logAsync);
+
+	MessageTypes types;
+	InitMessageTypes(types, maxData);
+	Histogram* latency = new Histogram;
+	InitHistogram(*latency);
+	double elapsed = 0;
 	
-	//main process
-	if (mpi_rank == 0) {
-		MainProcessFunc(mpi_rank, mpi_size);
+	//relay process
+	if (mode == routingRelay && mpi_rank == 0) {
+		MainProcessFunc(mpi_rank, mpi_size, types);
+	}//routers of destination ranges
+	else if (mpi_rank < FirstWorker(routing)) {
+		RouterProcessFunc(mpi_rank, types);
 	}//other processes
 	else {
-		SecondaryProcessesFunc(mpi_rank, mpi_size);
+		SecondaryProcessesFunc(mpi_rank, mpi_size, routing, load, poll, types, *latency, elapsed);
 	}
 
-	MPI_Finalize();
-	
+	FreeMessageTypes(types);
+	logger.Close();
+	if (load.benchmark) ReportBenchmark(mpi_rank, mpi_size, routing, load, maxData, *latency, elapsed);
+	delete latency;
+
 	if (mpi_rank==0) {
-		printf("Time taken: %.2fs\n", (double)(clock() - tStart)/CLOCKS_PER_SEC);
+		printf("Time taken: %.2fs\n", MPI_Wtime() - tStart);
 	}
+
+	metrics.Report("lab3", MPI_COMM_WORLD);
+	MPI_Finalize();
 	
 	return 0;
 }
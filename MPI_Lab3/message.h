@@ -0,0 +1,156 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t byte;
+
+//message: header, then length bytes of data
+//confirmation is header without data
+#pragma pack(push, 1)
+
+struct MessageHeader {
+	int32_t source;
+	int32_t destination;
+	int32_t id;
+	int32_t length; //bytes of data after header
+};
+
+#pragma pack(pop)
+
+//datatypes of messages for every length of data, they are made once,
+//so sending doesn't build datatypes
+//message with shorter data can be received with datatype of longer data (its prefix is the same)
+struct MessageTypes {
+	MPI_Datatype header;
+	MPI_Datatype* messages; //messages[length] is header with length chars
+	int maxData;
+};
+
+static void InitMessageTypes(MessageTypes& types, int maxData) {
+	int blocks[4] = {1, 1, 1, 1};
+	MPI_Aint displs[4] = {offsetof(MessageHeader, source), offsetof(MessageHeader, destination),
+		offsetof(MessageHeader, id), offsetof(MessageHeader, length)};
+	MPI_Datatype fields[4] = {MPI_INT, MPI_INT, MPI_INT, MPI_INT};
+	MPI_Type_create_struct(4, blocks, displs, fields, &(types.header));
+	MPI_Type_commit(&(types.header));
+
+	types.maxData = maxData;
+	types.messages = new MPI_Datatype[maxData + 1];
+	for (int length = 0; length <= maxData; length++) {
+		int parts[2] = {1, length};
+		MPI_Aint offsets[2] = {0, sizeof (MessageHeader)};
+		MPI_Datatype partTypes[2] = {types.header, MPI_CHAR};
+		MPI_Type_create_struct(2, parts, offsets, partTypes, &(types.messages[length]));
+		MPI_Type_commit(&(types.messages[length]));
+	}
+}
+
+static void FreeMessageTypes(MessageTypes& types) {
+	for (int length = 0; length <= types.maxData; length++) {
+		MPI_Type_free(&(types.messages[length]));
+	}
+	delete[] types.messages;
+	MPI_Type_free(&(types.header));
+}
+
+//preallocated buffers of messages with max length of data, free buffers are in ring
+struct MessagePool {
+	byte* memory;
+	int* ring; //indices of free buffers
+	int capacity;
+	int first; //first free buffer in ring
+	int count; //free buffers
+	int bufferSize;
+};
+
+static void InitMessagePool(MessagePool& pool, int capacity, int maxData) {
+	pool.bufferSize = (sizeof (MessageHeader) + maxData + 7) / 8 * 8;
+	pool.capacity = capacity;
+	pool.memory = new byte[(long) capacity * pool.bufferSize];
+	pool.ring = new int[capacity];
+	for (int i = 0; i < capacity; i++) {
+		pool.ring[i] = i;
+	}
+	pool.first = 0;
+	pool.count = capacity;
+}
+
+static void FreeMessagePool(MessagePool& pool) {
+	delete[] pool.memory;
+	delete[] pool.ring;
+}
+
+//index of free buffer or -1 if all buffers are used
+static int AcquireBuffer(MessagePool& pool) {
+	if (pool.count == 0) return -1;
+	int index = pool.ring[pool.first];
+	pool.first = (pool.first + 1) % pool.capacity;
+	pool.count--;
+	return index;
+}
+
+static void ReleaseBuffer(MessagePool& pool, int index) {
+	pool.ring[(pool.first + pool.count) % pool.capacity] = index;
+	pool.count++;
+}
+
+//owner of one buffer of pool, it can be moved but not copied, buffer is returned to pool by destructor
+class MessageBuffer {
+public:
+	MessageBuffer() : pool(NULL), index(-1) {
+	}
+
+	explicit MessageBuffer(MessagePool& pool) : pool(&pool), index(AcquireBuffer(pool)) {
+	}
+
+	MessageBuffer(MessageBuffer&& other) : pool(other.pool), index(other.index) {
+		other.index = -1;
+	}
+
+	MessageBuffer& operator=(MessageBuffer&& other) {
+		if (this != &other) {
+			Release();
+			pool = other.pool;
+			index = other.index;
+			other.index = -1;
+		}
+		return *this;
+	}
+
+	MessageBuffer(const MessageBuffer&) = delete;
+	MessageBuffer& operator=(const MessageBuffer&) = delete;
+
+	~MessageBuffer() {
+		Release();
+	}
+
+	void Release() {
+		if (index >= 0) ReleaseBuffer(*pool, index);
+		index = -1;
+	}
+
+	bool Empty() const {
+		return index < 0;
+	}
+
+	byte* Bytes() const {
+		return &(pool->memory[(long) index * pool->bufferSize]);
+	}
+
+	MessageHeader* Header() const {
+		return (MessageHeader*) Bytes();
+	}
+
+	char* Data() const {
+		return (char*) (Bytes() + sizeof (MessageHeader));
+	}
+
+private:
+	MessagePool* pool;
+	int index;
+};
+
+#endif /* MESSAGE_H */
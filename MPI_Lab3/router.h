@@ -0,0 +1,163 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <mpi.h>
+#include <stdio.h>
+#include "message.h"
+#include "../common/metrics.h"
+#include "../common/log.h"
+
+//routing of messages between workers
+//router takes destination from header of message
+//  relay        - all messages go through process 0, it receives and sends them one by one
+//  direct       - workers send messages to destination at once, all processes are workers
+//  hierarchical - processes 0 .. routers-1 are routers, every router serves range of destinations,
+//                 router keeps receives posted for many messages and forwards them without blocking
+
+enum RoutingModes {
+	routingRelay,
+	routingDirect,
+	routingHierarchical
+};
+
+const int routerSlots = 16; //messages which router can receive and forward at once
+const double routerReportPeriod = 5; //seconds between reports of router
+
+struct Routing {
+	RoutingModes mode;
+	int routers; //processes which only forward messages, workers are next processes
+};
+
+static void InitRouting(Routing& routing, RoutingModes mode, int routers) {
+	routing.mode = mode;
+	if (mode == routingRelay) {
+		routing.routers = 1;
+	} else if (mode == routingDirect) {
+		routing.routers = 0;
+	} else {
+		routing.routers = (routers > 0) ? routers : 1;
+	}
+}
+
+static int FirstWorker(const Routing& routing) {
+	return routing.routers;
+}
+
+//router of destination: destinations are divided to equal ranges
+static int RouterOf(const Routing& routing, int destination, int mpi_size) {
+	int workers = mpi_size - routing.routers;
+	return (long) (destination - routing.routers) * routing.routers / workers;
+}
+
+//process where worker sends message for destination
+static int NextHop(const Routing& routing, int destination, int mpi_size) {
+	if (routing.mode == routingRelay) return 0;
+	if (routing.mode == routingDirect) return destination;
+	return RouterOf(routing, destination, mpi_size);
+}
+
+//throughput and queue of router
+struct RouterStats {
+	long forwarded; //messages
+	long bytes;
+	int depth; //messages received and not forwarded yet
+	int maxDepth;
+	double depthSum; //sum of depth after every received message, for mean depth
+	double tStart, tReport;
+};
+
+static void InitRouterStats(RouterStats& stats) {
+	stats.forwarded = stats.bytes = 0;
+	stats.depth = stats.maxDepth = 0;
+	stats.depthSum = 0;
+	stats.tStart = stats.tReport = MPI_Wtime();
+}
+
+static void RouterReceived(RouterStats& stats) {
+	stats.depth++;
+	if (stats.depth > stats.maxDepth) stats.maxDepth = stats.depth;
+	stats.depthSum += stats.depth;
+}
+
+static void RouterForwarded(RouterStats& stats, int count) {
+	stats.depth--;
+	stats.forwarded++;
+	stats.bytes += count;
+}
+
+//prints stats once in routerReportPeriod seconds
+static void ReportRouterStats(RouterStats& stats, int mpi_rank) {
+	double now = MPI_Wtime();
+	if (now - stats.tReport < routerReportPeriod) return;
+	stats.tReport = now;
+
+	double seconds = now - stats.tStart;
+	logger.Printf("[router %d] forwarded %ld messages (%.1f msg/s, %.1f KB/s). Queue depth: %d, mean %.2f, max %d\n",
+			mpi_rank, stats.forwarded, stats.forwarded / seconds, stats.bytes / seconds / 1024,
+			stats.depth, (stats.forwarded > 0) ? stats.depthSum / stats.forwarded : 0.0, stats.maxDepth);
+}
+
+//router of hierarchical mode
+//every slot is buffer with posted receive, received message is sent from the same buffer,
+//when sending is done, receive is posted again
+//router works until barrier of all processes is done (workers enter it when all their messages are confirmed)
+void RouterProcessFunc(int mpi_rank, const MessageTypes& types) {
+	MessagePool pool;
+	InitMessagePool(pool, routerSlots, types.maxData);
+	MessageBuffer* slots = new MessageBuffer[routerSlots];
+	MPI_Request* requests = new MPI_Request[routerSlots + 1]; //last is barrier
+	bool* sending = new bool[routerSlots];
+	RouterStats stats;
+	InitRouterStats(stats);
+
+	for (int i = 0; i < routerSlots; i++) {
+		slots[i] = MessageBuffer(pool);
+		MPI_Irecv(slots[i].Bytes(), 1, types.messages[types.maxData], MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &(requests[i]));
+		sending[i] = false;
+	}
+	MPI_Ibarrier(MPI_COMM_WORLD, &(requests[routerSlots]));
+
+	while (true) {
+		int slot;
+		MPI_Status status;
+		metrics.Start(phaseReceive);
+		MPI_Waitany(routerSlots + 1, requests, &slot, &status);
+		metrics.Stop(phaseReceive);
+		if (slot == routerSlots) break;
+		MessageHeader* header = slots[slot].Header();
+		int count = sizeof (MessageHeader) + header->length;
+
+		if (sending[slot]) {
+			//message is forwarded, slot is free for next message
+			RouterForwarded(stats, count);
+			MPI_Irecv(slots[slot].Bytes(), 1, types.messages[types.maxData], MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &(requests[slot]));
+			sending[slot] = false;
+		} else {
+			//message is received, forward it to destination
+			metrics.AddBytes(callRecv, count);
+			RouterReceived(stats);
+
+			metrics.Start(phaseSend);
+			MPI_Isend(slots[slot].Bytes(), 1, types.messages[header->length], header->destination, status.MPI_TAG, MPI_COMM_WORLD, &(requests[slot]));
+			metrics.Stop(phaseSend);
+			metrics.AddBytes(callSend, count);
+			sending[slot] = true;
+		}
+
+		ReportRouterStats(stats, mpi_rank);
+	}
+
+	//all messages are delivered, posted receives aren't needed
+	for (int i = 0; i < routerSlots; i++) {
+		if (!sending[i]) MPI_Cancel(&(requests[i]));
+	}
+	MPI_Waitall(routerSlots, requests, MPI_STATUSES_IGNORE);
+
+	//buffers are returned before pool is freed
+	delete[] slots;
+	FreeMessagePool(pool);
+	delete[] requests;
+	delete[] sending;
+}
+
+#endif /* ROUTER_H */
@@ -0,0 +1,103 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+//hashed timer wheel: time is divided to ticks, timer of tick t is in slot t % slots,
+//timers which are more than one round ahead stay in slot until their tick comes
+//schedule is O(1), expiration visits only slots of passed ticks (at most all slots once)
+
+const double timerTick = 0.0001; //seconds, resolution of timers
+const int timerSlots = 1024;
+const int timerCapacity = 64; //max count of scheduled timers
+
+struct TimerWheel {
+	double tStart;
+	long current; //last processed tick
+	int slots[timerSlots]; //first timer of slot or -1
+	long ticks[timerCapacity]; //tick when timer expires
+	int events[timerCapacity]; //what to do when timer expires
+	int next[timerCapacity]; //next timer of slot or next free timer
+	int free; //first free timer or -1
+	int count; //scheduled timers
+};
+
+static void InitTimerWheel(TimerWheel& wheel, double tStart) {
+	wheel.tStart = tStart;
+	wheel.current = 0;
+	for (int i = 0; i < timerSlots; i++) {
+		wheel.slots[i] = -1;
+	}
+	for (int i = 0; i < timerCapacity; i++) {
+		wheel.next[i] = (i + 1 < timerCapacity) ? i + 1 : -1;
+	}
+	wheel.free = 0;
+	wheel.count = 0;
+}
+
+static long TimerTickOf(const TimerWheel& wheel, double time) {
+	return (long) ((time - wheel.tStart) / timerTick);
+}
+
+//event will be returned by ExpireTimers at time due or a bit later, false if there is no free timer
+static bool ScheduleTimer(TimerWheel& wheel, double due, int event) {
+	if (wheel.free < 0) return false;
+
+	int timer = wheel.free;
+	wheel.free = wheel.next[timer];
+
+	//first tick which begins not earlier than due, timer in the past expires at next tick
+	long tick = TimerTickOf(wheel, due) + 1;
+	if (tick <= wheel.current) tick = wheel.current + 1;
+
+	int slot = tick % timerSlots;
+	wheel.ticks[timer] = tick;
+	wheel.events[timer] = event;
+	wheel.next[timer] = wheel.slots[slot];
+	wheel.slots[slot] = timer;
+	wheel.count++;
+	return true;
+}
+
+//writes events of timers expired until time now, returns their count (not more than maxEvents)
+static int ExpireTimers(TimerWheel& wheel, double now, int* events, int maxEvents) {
+	long target = TimerTickOf(wheel, now);
+	long steps = target - wheel.current;
+	if (steps > timerSlots) steps = timerSlots;
+
+	int fired = 0;
+	for (long s = 1; s <= steps && fired < maxEvents; s++) {
+		int slot = (wheel.current + s) % timerSlots;
+		int* link = &(wheel.slots[slot]);
+		while (*link >= 0 && fired < maxEvents) {
+			int timer = *link;
+			if (wheel.ticks[timer] <= target) {
+				*link = wheel.next[timer];
+				events[fired++] = wheel.events[timer];
+				wheel.next[timer] = wheel.free;
+				wheel.free = timer;
+				wheel.count--;
+			} else {
+				link = &(wheel.next[timer]);
+			}
+		}
+	}
+
+	//if there are more expired timers, they are taken by next call
+	if (fired < maxEvents) wheel.current = target;
+	return fired;
+}
+
+//seconds until first timer expires, or -1 if there are no timers
+static double NextTimerDelay(const TimerWheel& wheel, double now) {
+	if (wheel.count == 0) return -1;
+
+	long first = -1;
+	for (int i = 0; i < timerSlots; i++) {
+		for (int timer = wheel.slots[i]; timer >= 0; timer = wheel.next[timer]) {
+			if (first < 0 || wheel.ticks[timer] < first) first = wheel.ticks[timer];
+		}
+	}
+	double delay = wheel.tStart + first * timerTick - now;
+	return (delay > 0) ? delay : 0;
+}
+
+#endif /* TIMER_H */
@@ -1,97 +1,585 @@
 #include <mpich/mpi.h>
 #include <stdlib.h>
-#include <time.h>
+#include <unistd.h>
 #include <iostream>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include "reduce.h"
+#include "scan.h"
+#include "sort.h"
+#include "../common/binfile.h"
+#include "../common/metrics.h"
+#include "../common/bench.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-int main(int argc, char* argv[]) {
-    
-    clock_t tStart;
-    int mpi_rank, mpi_size;
+//operations with distributed array
+enum Tasks {
+    taskReduce = 0, //reduction with operation of ReduceOps
+    taskScan = 1, //inclusive prefix sums
+    taskExscan = 2, //exclusive prefix sums
+    taskSort = 3 //sample sort
+};
+
+const char* const taskNames[] = {"reduce", "scan", "exscan", "sort"};
+
+static const char* TaskName(int task) {
+    return taskNames[task];
+}
+
+//task by name from command line, -1 if there is no such task
+static int ParseTask(const char* name) {
+    for (int task = taskReduce; task <= taskSort; task++) {
+        if (strcmp(name, taskNames[task]) == 0) return task;
+    }
+    return -1;
+}
+
+//random element: integers are from [0, RAND_MAX], floating point numbers from [0, 1]
+template <typename T>
+static T RandomElement() {
+    typedef typename Element<T>::Acc Acc;
+    if (std::numeric_limits<Acc>::is_integer) return Element<T>::FromAcc((Acc) rand());
+    return Element<T>::FromAcc((Acc) rand() / (Acc) RAND_MAX);
+}
+
+//allocates array and fills it with zeros from all threads
+//so its pages are placed at NUMA node of threads which will reduce them
+template <typename T>
+T* AllocateTouched(long size) {
+    T* arr = new T[size];
+
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < size; i++) {
+        arr[i] = T();
+    }
+    return arr;
+}
+
+//process 0 generates array by chunks and sends them with MPI_Iscatter
+//all processes reduce previous chunk while next one is generated and sent
+//so memory of process 0 is limited by 2 chunks of all processes instead of full array
+template <typename T>
+void ScatterReduceStreaming(long sizePerProcess, long chunkPerProcess, int op, Reduction<T>& result, int mpi_rank, int mpi_size) {
+    long chunksCount = (sizePerProcess + chunkPerProcess - 1) / chunkPerProcess;
+
+    //two buffers: one is sent, other is summed
+    T* sendChunks[2] = {NULL, NULL};
+    T* recvChunks[2];
+    long counts[2];
+    MPI_Request requests[2];
+
+    for (int b = 0; b < 2; b++) {
+        recvChunks[b] = AllocateTouched<T>(chunkPerProcess);
+        if (mpi_rank == 0) sendChunks[b] = new T[chunkPerProcess * mpi_size];
+    }
+
+    for (long c = 0; c <= chunksCount; c++) {
+        int cur = c % 2, prev = (c + 1) % 2;
+
+        //generate and start sending chunk c
+        if (c < chunksCount) {
+            counts[cur] = (sizePerProcess - c * chunkPerProcess < chunkPerProcess) ? (sizePerProcess - c * chunkPerProcess) : chunkPerProcess;
+
+            if (mpi_rank == 0) {
+                metrics.Start(phaseGenerate);
+                for (long i = 0; i < counts[cur] * mpi_size; i++) {
+                    sendChunks[cur][i] = RandomElement<T>();
+                }
+                metrics.Stop(phaseGenerate);
+            }
+            metrics.AddBytes(callScatter, counts[cur] * sizeof (T));
+            MPI_Iscatter(sendChunks[cur], counts[cur], Element<T>::Type(), recvChunks[cur], counts[cur], Element<T>::Type(), 0, MPI_COMM_WORLD, &requests[cur]);
+        }
+
+        //reduce chunk c-1 while chunk c is sent
+        if (c > 0) {
+            metrics.Start(phaseScatter);
+            MPI_Wait(&requests[prev], MPI_STATUS_IGNORE);
+            metrics.Stop(phaseScatter);
+
+            metrics.Start(phaseCompute);
+            ReduceLocal(recvChunks[prev], counts[prev], op, result);
+            metrics.Stop(phaseCompute);
+        }
+    }
+
+    for (int b = 0; b < 2; b++) {
+        delete[] recvChunks[b];
+        if (mpi_rank == 0) delete[] sendChunks[b];
+    }
+}
+
+//process 0 creates file of array from generated values by chunks
+template <typename T>
+bool GenerateArrayFile(const char* path, long size, long chunk) {
+    MPI_File file;
+    FileHeader header;
+    InitHeader(header, 1, size, 1, 0, Element<T>::dtype);
+    if (MPI_File_open(MPI_COMM_SELF, (char*) path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        return false;
+    }
+    MPI_File_set_size(file, 0);
+    MPI_File_write_at(file, 0, &header, sizeof (header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    T* values = new T[chunk];
+    for (long i = 0; i < size; i += chunk) {
+        long count = (size - i < chunk) ? (size - i) : chunk;
+        for (long j = 0; j < count; j++) {
+            values[j] = RandomElement<T>();
+        }
+        MPI_File_write_at(file, sizeof (header) + i * sizeof (T), values, count, Element<T>::Type(), MPI_STATUS_IGNORE);
+    }
+    delete[] values;
+
+    MPI_File_close(&file);
+    return true;
+}
+
+//gathers parts of distributed array with any sizes to process 0 (for test)
+//returns full array on process 0 and NULL on other processes
+void* GatherParts(const void* part, long size, MPI_Datatype type, MPI_Comm comm) {
+    int mpi_rank, mpi_size, typeSize;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+    MPI_Type_size(type, &typeSize);
+
+    int count = size;
+    int* counts = new int[mpi_size];
+    int* displs = new int[mpi_size];
+    MPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+    char* full = NULL;
+    if (mpi_rank == 0) {
+        long total = 0;
+        for (int i = 0; i < mpi_size; i++) {
+            displs[i] = total;
+            total += counts[i];
+        }
+        full = new char[(total + 1) * typeSize];
+    }
+    MPI_Gatherv((void*) part, count, type, full, counts, displs, type, 0, comm);
+
+    delete[] counts;
+    delete[] displs;
+    return full;
+}
+
+//process 0 reads full file of array (for test)
+int* LoadArrayFile(const char* path, long size) {
+    MPI_File file;
+    FileHeader header;
+    int* arr = new int[size + 1];
+    if (!OpenDataFile(path, MPI_COMM_SELF, file, header, dtypeInt32)) return arr;
+
+    const long part = 1 << 28; //count of MPI functions is int
+    for (long i = 0; i < size; i += part) {
+        int count = (size - i < part) ? (int) (size - i) : (int) part;
+        MPI_File_read_at(file, sizeof (header) + i * sizeof (int), arr + i, count, MPI_INT, MPI_STATUS_IGNORE);
+    }
+
+    MPI_File_close(&file);
+    return arr;
+}
+
+//process 0 reduces file of array by chunks with linear method (for test)
+template <typename T>
+void ReduceFileLinear(const char* path, long chunk, Reduction<T>& result) {
+    MPI_File file;
+    FileHeader header;
+    if (!OpenDataFile(path, MPI_COMM_SELF, file, header, Element<T>::dtype)) return;
+
+    T* values = new T[chunk];
+    long size = ElementsCount(header);
+    for (long i = 0; i < size; i += chunk) {
+        long count = (size - i < chunk) ? (size - i) : chunk;
+        MPI_File_read_at(file, sizeof (header) + i * sizeof (T), values, count, Element<T>::Type(), MPI_STATUS_IGNORE);
+        for (long j = 0; j < count; j++) {
+            ReduceLinear(values[j], result);
+        }
+    }
+    delete[] values;
+
+    MPI_File_close(&file);
+}
+
+//scan or sort of part of array of this process (collective), only for int elements
+static void OrderTask(int task, const int* arrPart, long size, long*& scanPart, int*& sortedPart, long& sortedSize) {
+    if (task == taskScan || task == taskExscan) {
+        if (scanPart == NULL) scanPart = new long[size + 1];
+        ScanDistributed(arrPart, size, task == taskExscan, scanPart, MPI_COMM_WORLD);
+    } else if (task == taskSort) {
+        if (sortedPart != NULL) delete[] sortedPart;
+        sortedPart = SampleSort(arrPart, size, sortedSize, MPI_COMM_WORLD);
+    }
+}
+
+//other types are rejected in main
+template <typename T>
+static void OrderTask(int, const T*, long, long*&, int*&, long&) {
+}
+
+//compares gathered result of scan or sort with linear method
+static int CheckOrderTask(int task, int* arrFull, long sizeFull, const long* scanFull, const int* sortedFull) {
+    if (task == taskSort) {
+        std::sort(arrFull, arrFull + sizeFull);
+        return memcmp(arrFull, sortedFull, sizeFull * sizeof (int)) == 0;
+    }
 
-    MPI_Init(&argc, &argv);
+    long sum = 0;
+    int checked = 1;
+    for (long i = 0; i < sizeFull; i++) {
+        if (task == taskScan) sum += arrFull[i];
+        if (scanFull[i] != sum) checked = 0;
+        if (task == taskExscan) sum += arrFull[i];
+    }
+    return checked;
+}
+
+template <typename T>
+static int CheckOrderTask(int, T*, long, const long*, const int*) {
+    return -1;
+}
+
+//options of command line
+struct Options {
+    long sizePerProcess;
+    bool streamInput; //generate and send array by chunks instead of full array
+    long chunkPerProcess; //size of chunk per process for streaming
+    int task; //operation with distributed array
+    int op; //operation of reduction
+    bool resultToAll; //all processes get result (MPI_Allreduce) or only process 0 (MPI_Reduce)
+    int warmup, repeats;
+    bool check; //compare result with linear method
+    const char* fileName; //file of array or NULL
+};
+
+//operation with array of elements of type T
+//returns false if file of array can't be read
+template <typename T>
+static bool Run(const Options& options) {
+    long sizePerProcess = options.sizePerProcess;
+    bool streamInput = options.streamInput;
+    long chunkPerProcess = options.chunkPerProcess;
+    int task = options.task;
+    int op = options.op;
+    bool resultToAll = options.resultToAll;
+    int warmup = options.warmup, repeats = options.repeats;
+    bool check = options.check;
+
+    double tStart;
+    int mpi_rank, mpi_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
-    
 
-    srand(1); //for generating same values every time
-    
-    long sizePerProcess=20000000;
-    
-    //if (mpi_rank==0) {
-    //    std::cout << "=================";
-    //    std::cout << "\nEnter size of array per process:\n";
-    //    std::cin >> sizePerProcess;
-    //}
-    //MPI_Bcast(&sizePerProcess, 1, MPI_LONG, 0, MPI_COMM_WORLD);
-    
     long sizeFull = mpi_size * sizePerProcess;
 
-    int* arrFull; //full array
-    int* arrPart = new int[sizePerProcess]; //part of array per process
-    long* sums; //array of sums of partial arrays for process 0
-    long sumPart=0; //sum of partial array of this process
+    //file of array
+    const char* fileName = options.fileName;
+    MPI_File file;
+    FileHeader header;
+    long fileOffset = 0; //first element of part of this process in file
+
+    if (fileName != NULL) {
+        int written = 1;
+        if (mpi_rank == 0 && !FileExists(fileName)) {
+            metrics.Start(phaseGenerate);
+            written = GenerateArrayFile<T>(fileName, sizeFull, chunkPerProcess);
+            metrics.Stop(phaseGenerate);
+        }
+
+        //other processes wait for file and don't open it if it wasn't written
+        MPI_Bcast(&written, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!written) {
+            if (mpi_rank == 0) std::cout << "\nFile of array can't be written\n";
+            return false;
+        }
+
+        bool opened = OpenDataFile(fileName, MPI_COMM_WORLD, file, header, Element<T>::dtype);
+        if (!opened || header.dims != 1) {
+            if (mpi_rank == 0) std::cout << "\nFile of array can't be read\n";
+            if (opened) MPI_File_close(&file);
+            return false;
+        }
+
+        //if array can't be divided equally, first processes get 1 element more
+        sizeFull = ElementsCount(header);
+        sizePerProcess = sizeFull / mpi_size;
+        fileOffset = sizePerProcess * mpi_rank + ((mpi_rank < sizeFull % mpi_size) ? mpi_rank : sizeFull % mpi_size);
+        if (mpi_rank < sizeFull % mpi_size) sizePerProcess++;
+        streamInput = false;
+    }
+
+    T* arrFull = NULL; //full array
+    T* arrPart; //part of array per process
+    Reduction<T> resultPart; //result of reduction of partial array of this process
+    Reduction<T> resultFull; //result of reduction of full array
+    long* scanPart = NULL; //prefix sums of part of array of this process
+    int* sortedPart = NULL; //part of sorted array of this process
+    long sortedSize = 0;
 
     //main process
     if (mpi_rank == 0) {
-        arrFull = new int[sizeFull];
-        sums = new long[mpi_size];
-
         //generating full array
-        for (long i = 0; i < sizeFull; i++) {
-            arrFull[i] = rand();
+        if (!streamInput && fileName == NULL) {
+            metrics.Start(phaseGenerate);
+            arrFull = new T[sizeFull];
+            for (long i = 0; i < sizeFull; i++) {
+                arrFull[i] = RandomElement<T>();
+            }
+            metrics.Stop(phaseGenerate);
         }
         
 
         std::cout << "\n=================";
         std::cout << "\nArray size = " << sizeFull;
         std::cout << "\nProcesses count = " << mpi_size;
+#ifdef _OPENMP
+        std::cout << "\nThreads per process = " << omp_get_max_threads();
+#endif
         std::cout << "\nArray size per process = " << sizePerProcess;
+        std::cout << "\nType of elements = " << dataTypeNames[Element<T>::dtype];
+        if (fileName != NULL) {
+            std::cout << "\nArray is read from " << fileName;
+        }
+        if (task == taskReduce) {
+            std::cout << "\nOperation = " << ReduceOpName(op, Element<T>::Tolerance() > 0) << ((resultToAll) ? " (MPI_Allreduce)" : " (MPI_Reduce)");
+        } else {
+            std::cout << "\nOperation = " << TaskName(task);
+        }
+        if (streamInput) {
+            std::cout << "\nStreaming chunk per process = " << chunkPerProcess << " (time includes generation)";
+        }
+        std::cout << "\nRepetitions = " << repeats << " (warmup " << warmup << ")";
         std::cout << "\n=================";
-        
-        //calc execution time
-        tStart=clock();
+    }
+
+    //repeat parallel operation, time of each repetition is time of slowest process
+    Benchmark bench;
+    InitBenchmark(bench, warmup, repeats);
+    for (int r = 0; r < RepetitionsCount(bench); r++) {
+        tStart = StartRepetition(MPI_COMM_WORLD);
+        resultPart = Reduction<T>();
+        resultFull = Reduction<T>();
 
+        if (streamInput) {
+            //every repetition generates same values
+            if (mpi_rank == 0) srand(1);
+            ScatterReduceStreaming(sizePerProcess, chunkPerProcess, op, resultPart, mpi_rank, mpi_size);
+        } else {
+            arrPart = AllocateTouched<T>(sizePerProcess);
+
+            if (fileName != NULL) {
+                //read part of array
+                metrics.Start(phaseIO);
+                ReadArraySlice(file, fileOffset, sizePerProcess, arrPart);
+                metrics.Stop(phaseIO);
+                metrics.AddBytes(callFileRead, sizePerProcess * sizeof (T));
+            } else {
+                //send parts of array
+                metrics.Start(phaseScatter);
+                MPI_Scatter(arrFull, sizePerProcess, Element<T>::Type(), arrPart, sizePerProcess, Element<T>::Type(), 0, MPI_COMM_WORLD);
+                metrics.Stop(phaseScatter);
+                metrics.AddBytes(callScatter, sizePerProcess * sizeof (T));
+            }
+
+            if (task == taskReduce) {
+                //reduction of partial array
+                metrics.Start(phaseCompute);
+                ReduceLocal(arrPart, sizePerProcess, op, resultPart);
+                metrics.Stop(phaseCompute);
+            } else {
+                OrderTask(task, arrPart, sizePerProcess, scanPart, sortedPart, sortedSize);
+            }
+            delete[] arrPart;
+        }
+
+        //combine results of processes
+        if (task == taskReduce) {
+            metrics.Start(phaseReduce);
+            ReduceGlobal(resultPart, resultFull, op, resultToAll, MPI_COMM_WORLD);
+            metrics.Stop(phaseReduce);
+            metrics.AddBytes(callReduce, sizeof (Reduction<T>));
+        }
+
+        StopRepetition(bench, tStart, MPI_COMM_WORLD);
     }
 
-    //send parts of array
-    MPI_Scatter(arrFull, sizePerProcess, MPI_INT, arrPart, sizePerProcess, MPI_INT, 0, MPI_COMM_WORLD);
-    
-    //sum of partial array
-    for (long i = 0; i < sizePerProcess; i++) {
-        sumPart+=arrPart[i];
+    if (fileName != NULL) MPI_File_close(&file);
+
+    //results of scan and sort are gathered to process 0 only for check
+    long* scanFull = NULL;
+    int* sortedFull = NULL;
+    if (check && (task == taskScan || task == taskExscan)) {
+        scanFull = (long*) GatherParts(scanPart, sizePerProcess, MPI_LONG, MPI_COMM_WORLD);
+    } else if (check && task == taskSort) {
+        sortedFull = (int*) GatherParts(sortedPart, sortedSize, MPI_INT, MPI_COMM_WORLD);
     }
-    
-    //gather partial array sums
-    MPI_Gather(&sumPart, 1, MPI_LONG, sums, 1, MPI_LONG, 0, MPI_COMM_WORLD);
 
     //main process
     if (mpi_rank==0) {
-        //sum partial sums
-        long sumFull=0;
-        for (int i = 0; i < mpi_size; i++) {
-            sumFull+=sums[i];
-        }
-        
         std::cout << "\nParallel:";
-        std::cout << "\nSum = " << sumFull;
-        
-        printf("\nTime taken: %.4fs", (double) (clock() - tStart) / CLOCKS_PER_SEC);
-        tStart=clock();
+        if (task == taskReduce) {
+            PrintReduction(resultFull, op);
+        } else if (task == taskSort) {
+            std::cout << "\nSorted part of process 0 = " << sortedSize << " elements";
+        }
         
-        //calc sum with 1 process for test
-        long test = 0;
-        for (long i = 0; i < sizeFull; i++) {
-            test+=arrFull[i];
+        printf("\nTime taken: %.4fs", ComputeStats(bench).mean);
+
+        //calc result with 1 process for test
+        //in streaming mode there is no full array, so generate same values again
+        int checked = -1;
+        if (check) {
+            tStart = MPI_Wtime();
+            metrics.Start(phaseLinear);
+
+            std::cout << "\n=================";
+            std::cout << "\nLinear:";
+            if (task == taskReduce) {
+                Reduction<T> test;
+                if (fileName != NULL) {
+                    ReduceFileLinear(fileName, chunkPerProcess, test);
+                } else if (streamInput) {
+                    srand(1);
+                    for (long i = 0; i < sizeFull; i++) {
+                        ReduceLinear(RandomElement<T>(), test);
+                    }
+                } else {
+                    for (long i = 0; i < sizeFull; i++) {
+                        ReduceLinear(arrFull[i], test);
+                    }
+                }
+                PrintReduction(test, op);
+                checked = EqualReductions(resultFull, test, op);
+            } else {
+                if (fileName != NULL) arrFull = (T*) LoadArrayFile(fileName, sizeFull);
+                checked = CheckOrderTask(task, arrFull, sizeFull, scanFull, sortedFull);
+                if (fileName != NULL) delete[] (int*) arrFull;
+            }
+
+            metrics.Stop(phaseLinear);
+            printf("\nTime taken: %.4fs", MPI_Wtime() - tStart);
+            std::cout << "\nResult is " << (checked ? "equal" : "NOT equal") << " to linear method";
         }
+        if (!streamInput && fileName == NULL) delete[] arrFull;
+
+        //work of one operation: one operation per element, whole array is read (and written by scan and sort)
+        double bytes = (double) sizeFull * sizeof (T);
+        if (task == taskScan || task == taskExscan) bytes += (double) sizeFull * sizeof (long);
+        if (task == taskSort) bytes *= 2;
         std::cout << "\n=================";
-        std::cout << "\nLinear:";
-        std::cout << "\nSum = " << test;
-        
-        printf("\nTime taken: %.4fs", (double) (clock() - tStart) / CLOCKS_PER_SEC);
+        std::string variant = (task == taskReduce) ? reduceOpKeys[op] : TaskName(task);
+        if (Element<T>::dtype != dtypeInt32) variant = variant + "-" + dataTypeNames[Element<T>::dtype];
+        PrintBenchmark(bench, "lab4", variant.c_str(), sizeFull, mpi_size, (double) sizeFull, bytes, checked);
         std::cout << "\n=================\n";
 
     }
+    FreeBenchmark(bench);
+    if (scanPart != NULL) delete[] scanPart;
+    if (sortedPart != NULL) delete[] sortedPart;
+    if (scanFull != NULL) delete[] scanFull;
+    if (sortedFull != NULL) delete[] sortedFull;
+
+    return true;
+}
+
+
+int main(int argc, char* argv[]) {
+    
+    int mpi_rank;
+
+    //only main thread of process calls MPI, other threads are used in calculations
+    int threadSupport;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
+    MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+    CheckThreadSupport(threadSupport, mpi_rank);
+    
+
+    srand(1); //for generating same values every time
+    
+    Options options;
+    options.sizePerProcess = 20000000;
+    options.streamInput = true; //generate and send array by chunks instead of full array
+    options.chunkPerProcess = 1000000; //size of chunk per process for streaming
+    options.task = taskReduce; //operation with distributed array
+    options.op = opSum; //operation of reduction
+    options.resultToAll = false; //all processes get result (MPI_Allreduce) or only process 0 (MPI_Reduce)
+    options.warmup = 0;
+    options.repeats = 1;
+    options.check = true; //compare result with linear method
+    int dtype = dtypeInt32; //type of elements of array
+    
+    //if (mpi_rank==0) {
+    //    std::cout << "=================";
+    //    std::cout << "\nEnter size of array per process:\n";
+    //    std::cin >> sizePerProcess;
+    //}
+    //MPI_Bcast(&sizePerProcess, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+
+    //options: mpi_lab4 [-t reduce|scan|exscan|sort] [-n sizePerProcess] [-o sum|sumwide|min|max|meanvar|histogram] [-e int32|int64|float|double|fp16|bf16] [-c chunk] [-a] [-w warmup] [-r repeats] [-x] [file]
+    //-c 0 sends full array without streaming, -a gives result of reduction to all processes, -x skips linear method and check of result
+    //-e is type of elements, fp16 and bf16 are reduced in float, scan and sort support only int32
+    //scan and sort keep parts of array on processes, so they don't use streaming
+    int option;
+    opterr = mpi_rank == 0; //errors of options are printed once
+    while ((option = getopt(argc, argv, "t:n:o:e:c:aw:r:x")) != -1) {
+        switch (option) {
+            case 't': options.task = ParseTask(optarg);
+                break;
+            case 'n': options.sizePerProcess = atol(optarg);
+                break;
+            case 'o': options.op = ParseReduceOp(optarg);
+                break;
+            case 'e': dtype = ParseDataType(optarg);
+                break;
+            case 'c': options.chunkPerProcess = atol(optarg);
+                options.streamInput = options.chunkPerProcess > 0;
+                break;
+            case 'a': options.resultToAll = true;
+                break;
+            case 'w': options.warmup = atoi(optarg);
+                break;
+            case 'r': options.repeats = atoi(optarg);
+                break;
+            case 'x': options.check = false;
+                break;
+            default: options.op = -1;
+        }
+    }
+    if (options.task < 0 || options.op < 0 || dtype < 0 || options.sizePerProcess <= 0
+            || (options.task != taskReduce && dtype != dtypeInt32)) {
+        if (mpi_rank == 0) std::cout << "\nUsage: mpi_lab4 [-t reduce|scan|exscan|sort] [-n sizePerProcess] [-o sum|sumwide|min|max|meanvar|histogram] [-e int32|int64|float|double|fp16|bf16] [-c chunk] [-a] [-w warmup] [-r repeats] [-x] [file]\n";
+        if (mpi_rank == 0 && options.task > taskReduce && dtype > dtypeInt32) std::cout << "Scan and sort support only int32\n";
+        MPI_Finalize();
+        return 0;
+    }
+    if (options.chunkPerProcess <= 0) options.chunkPerProcess = 1000000; //for reading file by process 0
+    if (options.chunkPerProcess > options.sizePerProcess) options.chunkPerProcess = options.sizePerProcess;
+    if (options.task != taskReduce) options.streamInput = false;
+
+    //file of array
+    //processes read their parts of array from file directly, if file doesn't exist, it is created from generated values
+    options.fileName = (optind < argc) ? argv[optind] : NULL;
+
+    bool done;
+    switch (dtype) {
+        case dtypeInt64: done = Run<long>(options);
+            break;
+        case dtypeFloat32: done = Run<float>(options);
+            break;
+        case dtypeFloat64: done = Run<double>(options);
+            break;
+        case dtypeFloat16: done = Run<float16>(options);
+            break;
+        case dtypeBfloat16: done = Run<bfloat16>(options);
+            break;
+        default: done = Run<int>(options);
+    }
     
+    if (done) metrics.Report("lab4", MPI_COMM_WORLD);
     MPI_Finalize();
     
     return 0;
@@ -0,0 +1,822 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <mpich/mpi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <limits>
+#include "../common/element.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REDUCE_X86
+#include <immintrin.h>
+#endif
+
+//reduction of distributed array of elements of type T (int32, int64, float, double, fp16, bf16)
+//every process reduces its part with vectorized kernels (and threads),
+//then results of processes are combined with MPI_Reduce or MPI_Allreduce
+//integers are summed exactly, floating point numbers are summed in blocks in type of calculations
+//(float for float, fp16 and bf16), then sums of blocks are summed in double
+//wide sum of floating point numbers is compensated (Neumaier): every element is added in double
+//and rounding errors are kept in separate compensation, which is added to sum at the end
+
+//operations of reduction
+enum ReduceOps {
+    opSum = 0, //sum in long (double for floating point), combined with MPI_SUM
+    opSumWide = 1, //sum in 128 bits, can't overflow for any count of processes (compensated sum for floating point)
+    opMin = 2,
+    opMax = 3,
+    opMeanVariance = 4, //mean and variance, combined with user defined operation
+    opHistogram = 5 //count of elements in equal ranges of [0, RAND_MAX] ([0, 1] for floating point)
+};
+
+const int histogramBins = 16;
+const long reduceBlock = 1 << 16; //elements per block of threads
+
+//types of sums of block of array (reduceBlock elements) and of all elements
+template <typename T> struct Sums {
+    typedef float Block;
+    typedef double Total;
+};
+
+template <> struct Sums<int> {
+    typedef long Block;
+    typedef __int128 Total;
+};
+
+template <> struct Sums<long> {
+    typedef __int128 Block;
+    typedef __int128 Total;
+};
+
+template <> struct Sums<double> {
+    typedef double Block;
+    typedef double Total;
+};
+
+//result of reduction, min and max have type of calculations
+template <typename T>
+struct Reduction {
+    typedef typename Element<T>::Acc Value;
+
+    long count; //count of elements
+    typename Sums<T>::Total sum;
+    double compensation; //rounding errors of compensated sum, 0 for integers
+    Value min, max;
+    double mean, m2; //mean and sum of squared deviations from mean
+    long bins[histogramBins];
+
+    Reduction() {
+        count = 0;
+        sum = 0;
+        compensation = 0;
+        min = std::numeric_limits<Value>::max();
+        max = std::numeric_limits<Value>::lowest();
+        mean = 0;
+        m2 = 0;
+        memset(bins, 0, sizeof (bins));
+    }
+};
+
+//mean and variance of part of array for combining with MPI
+struct Moments {
+    double count, mean, m2;
+};
+
+//combines mean and squared deviations of two parts of array (Chan et al.)
+static void CombineMoments(Moments& into, const Moments& part) {
+    if (part.count == 0) return;
+    if (into.count == 0) {
+        into = part;
+        return;
+    }
+    double count = into.count + part.count;
+    double delta = part.mean - into.mean;
+    into.m2 += part.m2 + delta * delta * into.count * part.count / count;
+    into.mean += delta * part.count / count;
+    into.count = count;
+}
+
+//sum of floating point numbers with rounding errors of additions, real sum is sum + compensation
+struct CompensatedSum {
+    double sum, compensation;
+};
+
+//Neumaier's variant of Kahan summation: error of addition is taken from the smaller term
+static void AddCompensated(CompensatedSum& into, double value) {
+    double t = into.sum + value;
+    if (fabs(into.sum) >= fabs(value)) {
+        into.compensation += (into.sum - t) + value;
+    } else {
+        into.compensation += (value - t) + into.sum;
+    }
+    into.sum = t;
+}
+
+static void CombineCompensated(CompensatedSum& into, const CompensatedSum& part) {
+    AddCompensated(into, part.sum);
+    into.compensation += part.compensation;
+}
+
+//==================
+//local kernels
+
+template <typename T>
+static typename Sums<T>::Block SumScalar(const T* arr, long size) {
+    typename Sums<T>::Block s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    long i = 0;
+    for (; i + 4 <= size; i += 4) {
+        s0 += Element<T>::ToAcc(arr[i]);
+        s1 += Element<T>::ToAcc(arr[i + 1]);
+        s2 += Element<T>::ToAcc(arr[i + 2]);
+        s3 += Element<T>::ToAcc(arr[i + 3]);
+    }
+    for (; i < size; i++) s0 += Element<T>::ToAcc(arr[i]);
+    return s0 + s1 + s2 + s3;
+}
+
+template <typename T>
+static void SumCompensatedScalar(const T* arr, long size, CompensatedSum& result) {
+    for (long i = 0; i < size; i++) {
+        AddCompensated(result, Element<T>::ToAcc(arr[i]));
+    }
+}
+
+template <typename T>
+static void MinMaxScalar(const T* arr, long size, typename Element<T>::Acc& min, typename Element<T>::Acc& max) {
+    for (long i = 0; i < size; i++) {
+        typename Element<T>::Acc value = Element<T>::ToAcc(arr[i]);
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+}
+
+template <typename T>
+static double SquaredDeviationsScalar(const T* arr, long size, double mean) {
+    double s0 = 0, s1 = 0;
+    long i = 0;
+    for (; i + 2 <= size; i += 2) {
+        double d0 = Element<T>::ToAcc(arr[i]) - mean, d1 = Element<T>::ToAcc(arr[i + 1]) - mean;
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+    }
+    for (; i < size; i++) s0 += (Element<T>::ToAcc(arr[i]) - mean) * (Element<T>::ToAcc(arr[i]) - mean);
+    return s0 + s1;
+}
+
+#ifdef REDUCE_X86
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+//16 elements per step, 4 accumulators of 64 bit numbers
+static long SumAvx2(const int* arr, long size) {
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    long i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*) (arr + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*) (arr + i + 8));
+        acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v0)));
+        acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v0, 1)));
+        acc2 = _mm256_add_epi64(acc2, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v1)));
+        acc3 = _mm256_add_epi64(acc3, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v1, 1)));
+    }
+
+    long lanes[4];
+    acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1), _mm256_add_epi64(acc2, acc3));
+    _mm256_storeu_si256((__m256i*) lanes, acc0);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SumScalar(arr + i, size - i);
+}
+
+//min and max are long (type of calculations of int32), vectors start from limits of int
+static void MinMaxAvx2(const int* arr, long size, long& min, long& max) {
+    __m256i vmin0 = _mm256_set1_epi32(std::numeric_limits<int>::max()), vmin1 = vmin0;
+    __m256i vmax0 = _mm256_set1_epi32(std::numeric_limits<int>::lowest()), vmax1 = vmax0;
+    long i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*) (arr + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*) (arr + i + 8));
+        vmin0 = _mm256_min_epi32(vmin0, v0);
+        vmin1 = _mm256_min_epi32(vmin1, v1);
+        vmax0 = _mm256_max_epi32(vmax0, v0);
+        vmax1 = _mm256_max_epi32(vmax1, v1);
+    }
+
+    int lanesMin[8], lanesMax[8];
+    _mm256_storeu_si256((__m256i*) lanesMin, _mm256_min_epi32(vmin0, vmin1));
+    _mm256_storeu_si256((__m256i*) lanesMax, _mm256_max_epi32(vmax0, vmax1));
+    for (int j = 0; j < 8; j++) {
+        if (lanesMin[j] < min) min = lanesMin[j];
+        if (lanesMax[j] > max) max = lanesMax[j];
+    }
+    MinMaxScalar(arr + i, size - i, min, max);
+}
+
+//8 elements per step, 2 accumulators of 4 doubles
+static double SquaredDeviationsAvx2(const int* arr, long size, double mean) {
+    __m256d vmean = _mm256_set1_pd(mean);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = acc0;
+    long i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256d d0 = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (arr + i))), vmean);
+        __m256d d1 = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (arr + i + 4))), vmean);
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SquaredDeviationsScalar(arr + i, size - i, mean);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,f16c")
+
+//float, fp16 and bf16 are loaded as 8 floats, so they have the same kernels
+static inline __m256 LoadFloats(const float* arr) {
+    return _mm256_loadu_ps(arr);
+}
+
+static inline __m256 LoadFloats(const float16* arr) {
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) arr));
+}
+
+static inline __m256 LoadFloats(const bfloat16* arr) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) arr)), 16));
+}
+
+//16 elements per step, 2 accumulators of 8 floats
+template <typename T>
+static float SumFloatsAvx2(const T* arr, long size) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = acc0;
+    long i = 0;
+    for (; i + 16 <= size; i += 16) {
+        acc0 = _mm256_add_ps(acc0, LoadFloats(arr + i));
+        acc1 = _mm256_add_ps(acc1, LoadFloats(arr + i + 8));
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+    float sum = SumScalar(arr + i, size - i);
+    for (int j = 0; j < 8; j++) sum += lanes[j];
+    return sum;
+}
+
+template <typename T>
+static void MinMaxFloatsAvx2(const T* arr, long size, float& min, float& max) {
+    __m256 vmin0 = _mm256_set1_ps(min), vmin1 = vmin0;
+    __m256 vmax0 = _mm256_set1_ps(max), vmax1 = vmax0;
+    long i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m256 v0 = LoadFloats(arr + i);
+        __m256 v1 = LoadFloats(arr + i + 8);
+        vmin0 = _mm256_min_ps(vmin0, v0);
+        vmin1 = _mm256_min_ps(vmin1, v1);
+        vmax0 = _mm256_max_ps(vmax0, v0);
+        vmax1 = _mm256_max_ps(vmax1, v1);
+    }
+
+    float lanesMin[8], lanesMax[8];
+    _mm256_storeu_ps(lanesMin, _mm256_min_ps(vmin0, vmin1));
+    _mm256_storeu_ps(lanesMax, _mm256_max_ps(vmax0, vmax1));
+    for (int j = 0; j < 8; j++) {
+        if (lanesMin[j] < min) min = lanesMin[j];
+        if (lanesMax[j] > max) max = lanesMax[j];
+    }
+    MinMaxScalar(arr + i, size - i, min, max);
+}
+
+//8 elements per step, deviations are calculated in double
+template <typename T>
+static double SquaredDeviationsFloatsAvx2(const T* arr, long size, double mean) {
+    __m256d vmean = _mm256_set1_pd(mean);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = acc0;
+    long i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256 v = LoadFloats(arr + i);
+        __m256d d0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), vmean);
+        __m256d d1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), vmean);
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SquaredDeviationsScalar(arr + i, size - i, mean);
+}
+
+//double, float, fp16 and bf16 are loaded as 2 vectors of 4 doubles
+static inline void LoadDoubles(const double* arr, __m256d& low, __m256d& high) {
+    low = _mm256_loadu_pd(arr);
+    high = _mm256_loadu_pd(arr + 4);
+}
+
+template <typename T>
+static inline void LoadDoubles(const T* arr, __m256d& low, __m256d& high) {
+    __m256 v = LoadFloats(arr);
+    low = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+    high = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+}
+
+//compensated addition in every lane
+static inline void AddCompensatedAvx2(__m256d& sum, __m256d& compensation, __m256d value) {
+    __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    __m256d t = _mm256_add_pd(sum, value);
+    __m256d sumBigger = _mm256_cmp_pd(_mm256_and_pd(sum, absMask), _mm256_and_pd(value, absMask), _CMP_GE_OQ);
+    __m256d big = _mm256_blendv_pd(value, sum, sumBigger);
+    __m256d small = _mm256_blendv_pd(sum, value, sumBigger);
+    compensation = _mm256_add_pd(compensation, _mm256_add_pd(_mm256_sub_pd(big, t), small));
+    sum = t;
+}
+
+//8 elements per step, 2 compensated accumulators of 4 doubles
+template <typename T>
+static void SumCompensatedAvx2(const T* arr, long size, CompensatedSum& result) {
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = sum0, comp0 = sum0, comp1 = sum0;
+    long i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256d v0, v1;
+        LoadDoubles(arr + i, v0, v1);
+        AddCompensatedAvx2(sum0, comp0, v0);
+        AddCompensatedAvx2(sum1, comp1, v1);
+    }
+
+    double lanesSum[8], lanesComp[8];
+    _mm256_storeu_pd(lanesSum, sum0);
+    _mm256_storeu_pd(lanesSum + 4, sum1);
+    _mm256_storeu_pd(lanesComp, comp0);
+    _mm256_storeu_pd(lanesComp + 4, comp1);
+    for (int j = 0; j < 8; j++) {
+        CompensatedSum lane = {lanesSum[j], lanesComp[j]};
+        CombineCompensated(result, lane);
+    }
+    SumCompensatedScalar(arr + i, size - i, result);
+}
+
+#pragma GCC pop_options
+
+#endif
+
+static bool HasAvx2() {
+#ifdef REDUCE_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+//kernels of blocks: int has own vectorized kernels, float, fp16 and bf16 have common vectorized kernels,
+//long and double have portable kernels (vectorized by compiler)
+template <typename T>
+static typename Sums<T>::Block SumBlock(const T* arr, long size) {
+    return SumScalar(arr, size);
+}
+
+template <typename T>
+static void SumCompensatedBlock(const T* arr, long size, CompensatedSum& result) {
+    SumCompensatedScalar(arr, size, result);
+}
+
+template <typename T>
+static void MinMaxBlock(const T* arr, long size, typename Element<T>::Acc& min, typename Element<T>::Acc& max) {
+    MinMaxScalar(arr, size, min, max);
+}
+
+template <typename T>
+static double SquaredDeviationsBlock(const T* arr, long size, double mean) {
+    return SquaredDeviationsScalar(arr, size, mean);
+}
+
+template <>
+long SumBlock<int>(const int* arr, long size) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2();
+    if (avx2) return SumAvx2(arr, size);
+#endif
+    return SumScalar(arr, size);
+}
+
+template <>
+void MinMaxBlock<int>(const int* arr, long size, long& min, long& max) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2();
+    if (avx2) {
+        MinMaxAvx2(arr, size, min, max);
+        return;
+    }
+#endif
+    MinMaxScalar(arr, size, min, max);
+}
+
+template <>
+double SquaredDeviationsBlock<int>(const int* arr, long size, double mean) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2();
+    if (avx2) return SquaredDeviationsAvx2(arr, size, mean);
+#endif
+    return SquaredDeviationsScalar(arr, size, mean);
+}
+
+static bool HasAvx2F16c() {
+#ifdef REDUCE_X86
+    return HasAvx2() && __builtin_cpu_supports("f16c");
+#else
+    return false;
+#endif
+}
+
+template <typename T>
+static float SumFloatsBlock(const T* arr, long size) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2F16c();
+    if (avx2) return SumFloatsAvx2(arr, size);
+#endif
+    return SumScalar(arr, size);
+}
+
+template <typename T>
+static void SumCompensatedFloatsBlock(const T* arr, long size, CompensatedSum& result) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2F16c();
+    if (avx2) {
+        SumCompensatedAvx2(arr, size, result);
+        return;
+    }
+#endif
+    SumCompensatedScalar(arr, size, result);
+}
+
+template <typename T>
+static void MinMaxFloatsBlock(const T* arr, long size, float& min, float& max) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2F16c();
+    if (avx2) {
+        MinMaxFloatsAvx2(arr, size, min, max);
+        return;
+    }
+#endif
+    MinMaxScalar(arr, size, min, max);
+}
+
+template <typename T>
+static double SquaredDeviationsFloatsBlock(const T* arr, long size, double mean) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2F16c();
+    if (avx2) return SquaredDeviationsFloatsAvx2(arr, size, mean);
+#endif
+    return SquaredDeviationsScalar(arr, size, mean);
+}
+
+template <> float SumBlock<float>(const float* arr, long size) { return SumFloatsBlock(arr, size); }
+template <> float SumBlock<float16>(const float16* arr, long size) { return SumFloatsBlock(arr, size); }
+template <> float SumBlock<bfloat16>(const bfloat16* arr, long size) { return SumFloatsBlock(arr, size); }
+template <> void SumCompensatedBlock<float>(const float* arr, long size, CompensatedSum& result) { SumCompensatedFloatsBlock(arr, size, result); }
+template <> void SumCompensatedBlock<float16>(const float16* arr, long size, CompensatedSum& result) { SumCompensatedFloatsBlock(arr, size, result); }
+template <> void SumCompensatedBlock<bfloat16>(const bfloat16* arr, long size, CompensatedSum& result) { SumCompensatedFloatsBlock(arr, size, result); }
+template <> void SumCompensatedBlock<double>(const double* arr, long size, CompensatedSum& result) { SumCompensatedFloatsBlock(arr, size, result); }
+template <> void MinMaxBlock<float>(const float* arr, long size, float& min, float& max) { MinMaxFloatsBlock(arr, size, min, max); }
+template <> void MinMaxBlock<float16>(const float16* arr, long size, float& min, float& max) { MinMaxFloatsBlock(arr, size, min, max); }
+template <> void MinMaxBlock<bfloat16>(const bfloat16* arr, long size, float& min, float& max) { MinMaxFloatsBlock(arr, size, min, max); }
+template <> double SquaredDeviationsBlock<float>(const float* arr, long size, double mean) { return SquaredDeviationsFloatsBlock(arr, size, mean); }
+template <> double SquaredDeviationsBlock<float16>(const float16* arr, long size, double mean) { return SquaredDeviationsFloatsBlock(arr, size, mean); }
+template <> double SquaredDeviationsBlock<bfloat16>(const bfloat16* arr, long size, double mean) { return SquaredDeviationsFloatsBlock(arr, size, mean); }
+
+//bin of histogram: integers are from [0, RAND_MAX], floating point numbers from [0, 1]
+//values out of range (from files) go to first or last bin
+static int HistogramBin(long value) {
+    if (value < 0) return 0;
+    long bin = value / ((long) RAND_MAX / histogramBins + 1);
+    return (bin < histogramBins) ? (int) bin : histogramBins - 1;
+}
+
+static int HistogramBin(double value) {
+    int bin = (int) (value * histogramBins);
+    if (bin < 0) return 0;
+    return (bin < histogramBins) ? bin : histogramBins - 1;
+}
+
+//adds part of array to result of reduction, blocks of array are divided between threads
+template <typename T>
+static void ReduceLocal(const T* arr, long size, int op, Reduction<T>& result) {
+    typedef typename Sums<T>::Total Total;
+    typedef typename Element<T>::Acc Value;
+    long blocks = (size + reduceBlock - 1) / reduceBlock;
+    result.count += size;
+
+    if (op == opSumWide && !std::numeric_limits<Value>::is_integer) {
+        CompensatedSum sum = {(double) result.sum, result.compensation};
+
+        #pragma omp parallel
+        {
+            CompensatedSum sumThread = {0, 0};
+            #pragma omp for schedule(static)
+            for (long b = 0; b < blocks; b++) {
+                long count = (size - b * reduceBlock < reduceBlock) ? (size - b * reduceBlock) : reduceBlock;
+                SumCompensatedBlock(arr + b * reduceBlock, count, sumThread);
+            }
+            #pragma omp critical
+            CombineCompensated(sum, sumThread);
+        }
+        result.sum = sum.sum;
+        result.compensation = sum.compensation;
+    } else if (op == opSum || op == opSumWide || op == opMeanVariance) {
+        Total sum = 0;
+
+        #pragma omp parallel
+        {
+            Total sumThread = 0; //sums of blocks are long or float, sum of all blocks may be bigger
+            #pragma omp for schedule(static)
+            for (long b = 0; b < blocks; b++) {
+                long count = (size - b * reduceBlock < reduceBlock) ? (size - b * reduceBlock) : reduceBlock;
+                sumThread += SumBlock(arr + b * reduceBlock, count);
+            }
+            #pragma omp critical
+            sum += sumThread;
+        }
+        result.sum += sum;
+
+        //second pass for deviations from mean of this part
+        if (op == opMeanVariance && size > 0) {
+            Moments part = {(double) size, (double) sum / size, 0};
+            double m2 = 0;
+
+            #pragma omp parallel for schedule(static) reduction(+:m2)
+            for (long b = 0; b < blocks; b++) {
+                long count = (size - b * reduceBlock < reduceBlock) ? (size - b * reduceBlock) : reduceBlock;
+                m2 += SquaredDeviationsBlock(arr + b * reduceBlock, count, part.mean);
+            }
+            part.m2 = m2;
+
+            Moments all = {(double) (result.count - size), result.mean, result.m2};
+            CombineMoments(all, part);
+            result.mean = all.mean;
+            result.m2 = all.m2;
+        }
+    } else if (op == opMin || op == opMax) {
+        Value min = result.min, max = result.max;
+
+        #pragma omp parallel for schedule(static) reduction(min:min) reduction(max:max)
+        for (long b = 0; b < blocks; b++) {
+            long count = (size - b * reduceBlock < reduceBlock) ? (size - b * reduceBlock) : reduceBlock;
+            MinMaxBlock(arr + b * reduceBlock, count, min, max);
+        }
+        result.min = min;
+        result.max = max;
+    } else if (op == opHistogram) {
+        long* bins = result.bins;
+
+        #pragma omp parallel for schedule(static) reduction(+:bins[:histogramBins])
+        for (long i = 0; i < size; i++) {
+            bins[HistogramBin(Element<T>::ToAcc(arr[i]))]++;
+        }
+    }
+}
+
+//integers are added exactly, floating point numbers with compensation
+static void AddToSum(__int128& sum, double&, long value) {
+    sum += value;
+}
+
+static void AddToSum(double& sum, double& compensation, double value) {
+    CompensatedSum total = {sum, compensation};
+    AddCompensated(total, value);
+    sum = total.sum;
+    compensation = total.compensation;
+}
+
+//adds one element to result of reduction (simple linear method for test)
+template <typename T>
+static void ReduceLinear(T element, Reduction<T>& result) {
+    typename Element<T>::Acc value = Element<T>::ToAcc(element);
+    result.count++;
+    AddToSum(result.sum, result.compensation, value);
+    if (value < result.min) result.min = value;
+    if (value > result.max) result.max = value;
+
+    //Welford's method
+    double delta = value - result.mean;
+    result.mean += delta / result.count;
+    result.m2 += delta * (value - result.mean);
+
+    result.bins[HistogramBin(value)]++;
+}
+
+//==================
+//combining results of processes
+
+//user defined operation for sum of 128 bit numbers
+static void SumWideOp(void* in, void* inout, int* len, MPI_Datatype*) {
+    __int128* a = (__int128*) in;
+    __int128* b = (__int128*) inout;
+    for (int i = 0; i < *len; i++) {
+        b[i] += a[i];
+    }
+}
+
+//user defined operation for compensated sum of floating point numbers
+static void SumCompensatedOp(void* in, void* inout, int* len, MPI_Datatype*) {
+    CompensatedSum* a = (CompensatedSum*) in;
+    CompensatedSum* b = (CompensatedSum*) inout;
+    for (int i = 0; i < *len; i++) {
+        CombineCompensated(b[i], a[i]);
+    }
+}
+
+//user defined operation for combining mean and variance
+static void MomentsOp(void* in, void* inout, int* len, MPI_Datatype*) {
+    Moments* a = (Moments*) in;
+    Moments* b = (Moments*) inout;
+    for (int i = 0; i < *len; i++) {
+        CombineMoments(b[i], a[i]);
+    }
+}
+
+//result goes to all processes (MPI_Allreduce) or only to process 0 (MPI_Reduce)
+static void Collective(void* send, void* recv, int count, MPI_Datatype type, MPI_Op op, bool toAll, MPI_Comm comm) {
+    if (toAll) {
+        MPI_Allreduce(send, recv, count, type, op, comm);
+    } else {
+        MPI_Reduce(send, recv, count, type, op, 0, comm);
+    }
+}
+
+//sum of integers in long (MPI_SUM) or in 128 bits (user defined operation), integers have no compensation
+static void CombineSums(const __int128& local, double, __int128& global, double&, bool wide, bool toAll, MPI_Comm comm) {
+    if (!wide) {
+        long sendSum = (long) local, recvSum = 0;
+        Collective(&sendSum, &recvSum, 1, MPI_LONG, MPI_SUM, toAll, comm);
+        global = recvSum;
+        return;
+    }
+
+    MPI_Datatype type;
+    MPI_Op userOp;
+    MPI_Type_contiguous(sizeof (__int128), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+    MPI_Op_create(SumWideOp, 1, &userOp);
+    Collective((void*) &local, &global, 1, type, userOp, toAll, comm);
+    MPI_Op_free(&userOp);
+    MPI_Type_free(&type);
+}
+
+//sum of floating point numbers in double (MPI_SUM) or compensated sum (user defined operation)
+static void CombineSums(const double& local, double localCompensation, double& global, double& globalCompensation, bool wide, bool toAll, MPI_Comm comm) {
+    if (!wide) {
+        Collective((void*) &local, &global, 1, MPI_DOUBLE, MPI_SUM, toAll, comm);
+        return;
+    }
+
+    CompensatedSum sendSum = {local, localCompensation}, recvSum = {0, 0};
+    MPI_Datatype type;
+    MPI_Op userOp;
+    MPI_Type_contiguous(2, MPI_DOUBLE, &type);
+    MPI_Type_commit(&type);
+    MPI_Op_create(SumCompensatedOp, 1, &userOp);
+    Collective(&sendSum, &recvSum, 1, type, userOp, toAll, comm);
+    MPI_Op_free(&userOp);
+    MPI_Type_free(&type);
+    global = recvSum.sum;
+    globalCompensation = recvSum.compensation;
+}
+
+//combines results of all processes
+template <typename T>
+static void ReduceGlobal(const Reduction<T>& local, Reduction<T>& global, int op, bool toAll, MPI_Comm comm) {
+    MPI_Datatype type;
+    MPI_Op userOp;
+    MPI_Datatype valueType = Element<typename Element<T>::Acc>::Type();
+
+    Collective((void*) &local.count, &global.count, 1, MPI_LONG, MPI_SUM, toAll, comm);
+
+    if (op == opSum || op == opSumWide) {
+        CombineSums(local.sum, local.compensation, global.sum, global.compensation, op == opSumWide, toAll, comm);
+    } else if (op == opMin) {
+        Collective((void*) &local.min, &global.min, 1, valueType, MPI_MIN, toAll, comm);
+    } else if (op == opMax) {
+        Collective((void*) &local.max, &global.max, 1, valueType, MPI_MAX, toAll, comm);
+    } else if (op == opMeanVariance) {
+        Moments sendMoments = {(double) local.count, local.mean, local.m2}, recvMoments;
+        MPI_Type_contiguous(3, MPI_DOUBLE, &type);
+        MPI_Type_commit(&type);
+        MPI_Op_create(MomentsOp, 1, &userOp);
+        Collective(&sendMoments, &recvMoments, 1, type, userOp, toAll, comm);
+        MPI_Op_free(&userOp);
+        MPI_Type_free(&type);
+        global.mean = recvMoments.mean;
+        global.m2 = recvMoments.m2;
+    } else if (op == opHistogram) {
+        Collective((void*) local.bins, global.bins, histogramBins, MPI_LONG, MPI_SUM, toAll, comm);
+    }
+}
+
+//==================
+//output
+
+static std::string Int128ToString(__int128 value) {
+    if (value == 0) return "0";
+    bool negative = value < 0;
+    std::string digits;
+    while (value != 0) {
+        int digit = (int) (value % 10);
+        digits.insert(digits.begin(), (char) ('0' + (negative ? -digit : digit)));
+        value /= 10;
+    }
+    return negative ? "-" + digits : digits;
+}
+
+static std::string SumToString(__int128 sum) {
+    return Int128ToString(sum);
+}
+
+static std::string SumToString(double sum) {
+    char text[64];
+    snprintf(text, sizeof (text), "%.6f", sum);
+    return text;
+}
+
+//wide sum is in 128 bits for integers and compensated for floating point numbers
+static const char* ReduceOpName(int op, bool floating) {
+    switch (op) {
+        case opSum: return "sum";
+        case opSumWide: return floating ? "sum (compensated)" : "sum (128 bit)";
+        case opMin: return "min";
+        case opMax: return "max";
+        case opMeanVariance: return "mean and variance";
+        case opHistogram: return "histogram";
+    }
+    return "unknown";
+}
+
+//short names of operations for command line and benchmark results
+const char* const reduceOpKeys[] = {"sum", "sumwide", "min", "max", "meanvar", "histogram"};
+
+//operation by short name, -1 if there is no such operation
+static int ParseReduceOp(const char* name) {
+    for (int op = opSum; op <= opHistogram; op++) {
+        if (strcmp(name, reduceOpKeys[op]) == 0) return op;
+    }
+    return -1;
+}
+
+//count of elements in all bins of histogram, every element must be in some bin
+template <typename T>
+static long BinnedCount(const Reduction<T>& result) {
+    long count = 0;
+    for (int i = 0; i < histogramBins; i++) {
+        count += result.bins[i];
+    }
+    return count;
+}
+
+//sum with rounding errors of compensated sum
+template <typename T>
+static typename Sums<T>::Total TotalSum(const Reduction<T>& result) {
+    return result.sum + (typename Sums<T>::Total) result.compensation;
+}
+
+//compares results of operation op (mean and variance with relative error,
+//sums of floating point numbers with relative error of their type, compensated sums with relative error of double)
+template <typename T>
+static bool EqualReductions(const Reduction<T>& a, const Reduction<T>& b, int op) {
+    double tolerance = (Element<T>::Tolerance() > 1e-9) ? Element<T>::Tolerance() : 1e-9;
+    double sumTolerance = (op == opSumWide) ? 1e-12 : Element<T>::Tolerance(); //compensated sums differ by few roundings of double
+    switch (op) {
+        case opSum:
+        case opSumWide: return (Element<T>::Tolerance() == 0) ? a.sum == b.sum
+                    : fabs((double) (TotalSum(a) - TotalSum(b))) <= sumTolerance * fabs((double) TotalSum(b));
+        case opMin: return a.min == b.min;
+        case opMax: return a.max == b.max;
+        case opMeanVariance: return a.count == b.count
+                    && fabs(a.mean - b.mean) <= tolerance * fabs(b.mean) + tolerance
+                    && fabs(a.m2 - b.m2) <= tolerance * fabs(b.m2) + tolerance;
+        case opHistogram: return memcmp(a.bins, b.bins, sizeof (a.bins)) == 0 && BinnedCount(a) == a.count;
+    }
+    return false;
+}
+
+template <typename T>
+static void PrintReduction(const Reduction<T>& result, int op) {
+    if (op == opSum || op == opSumWide) {
+        std::cout << "\nSum = " << SumToString(TotalSum(result));
+    } else if (op == opMin) {
+        std::cout << "\nMin = " << result.min;
+    } else if (op == opMax) {
+        std::cout << "\nMax = " << result.max;
+    } else if (op == opMeanVariance) {
+        printf("\nMean = %.6f\nVariance = %.6e", result.mean, (result.count > 0) ? result.m2 / result.count : 0.0);
+    } else if (op == opHistogram) {
+        std::cout << "\nHistogram = ";
+        for (int i = 0; i < histogramBins; i++) {
+            std::cout << result.bins[i] << " ";
+        }
+    }
+}
+
+#endif /* REDUCE_H */
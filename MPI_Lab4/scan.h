@@ -0,0 +1,97 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <mpich/mpi.h>
+#include "reduce.h"
+#include "../common/metrics.h"
+
+//prefix sums of distributed array of int, result stays distributed like the array
+//every process sums blocks of its part, offset of part is sum of parts of previous processes (MPI_Exscan),
+//then every block is scanned from its own offset, so blocks are divided between threads
+//sums are long, they don't overflow for big arrays
+
+//out[i] = offset + arr[0] + ... + arr[i], or without arr[i] if exclusive
+static void ScanScalar(const int* arr, long size, long offset, bool exclusive, long* out) {
+    for (long i = 0; i < size; i++) {
+        long next = offset + arr[i];
+        out[i] = exclusive ? offset : next;
+        offset = next;
+    }
+}
+
+#ifdef REDUCE_X86
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+//4 elements per step, prefix sums inside vector are made by 2 shifts and adds
+static void ScanAvx2(const int* arr, long size, long offset, bool exclusive, long* out) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i carry = _mm256_set1_epi64x(offset);
+    long i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*) (arr + i)));
+        __m256i v = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03));
+        v = _mm256_add_epi64(v, _mm256_blend_epi32(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F));
+        v = _mm256_add_epi64(v, carry);
+        _mm256_storeu_si256((__m256i*) (out + i), exclusive ? _mm256_sub_epi64(v, x) : v);
+        carry = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    ScanScalar(arr + i, size - i, _mm256_extract_epi64(carry, 0), exclusive, out + i);
+}
+
+#pragma GCC pop_options
+
+#endif
+
+static void ScanBlock(const int* arr, long size, long offset, bool exclusive, long* out) {
+#ifdef REDUCE_X86
+    static bool avx2 = HasAvx2();
+    if (avx2) {
+        ScanAvx2(arr, size, offset, exclusive, out);
+        return;
+    }
+#endif
+    ScanScalar(arr, size, offset, exclusive, out);
+}
+
+//inclusive or exclusive prefix sums of part arr of distributed array (collective)
+static void ScanDistributed(const int* arr, long size, bool exclusive, long* out, MPI_Comm comm) {
+    long blocks = (size + reduceBlock - 1) / reduceBlock;
+    long* offsets = new long[blocks + 1];
+
+    //sums of blocks
+    metrics.Start(phaseCompute);
+    #pragma omp parallel for schedule(static)
+    for (long b = 0; b < blocks; b++) {
+        long count = (size - b * reduceBlock < reduceBlock) ? (size - b * reduceBlock) : reduceBlock;
+        offsets[b + 1] = SumBlock(arr + b * reduceBlock, count);
+    }
+    offsets[0] = 0;
+    for (long b = 0; b < blocks; b++) {
+        offsets[b + 1] += offsets[b];
+    }
+    metrics.Stop(phaseCompute);
+
+    //offset of part of this process, result of MPI_Exscan is undefined on process 0
+    int mpi_rank;
+    MPI_Comm_rank(comm, &mpi_rank);
+    long total = offsets[blocks], before = 0;
+    metrics.Start(phaseReduce);
+    MPI_Exscan(&total, &before, 1, MPI_LONG, MPI_SUM, comm);
+    metrics.Stop(phaseReduce);
+    metrics.AddBytes(callReduce, sizeof (long));
+    if (mpi_rank == 0) before = 0;
+
+    metrics.Start(phaseCompute);
+    #pragma omp parallel for schedule(static)
+    for (long b = 0; b < blocks; b++) {
+        long count = (size - b * reduceBlock < reduceBlock) ? (size - b * reduceBlock) : reduceBlock;
+        ScanBlock(arr + b * reduceBlock, count, before + offsets[b], exclusive, out + b * reduceBlock);
+    }
+    metrics.Stop(phaseCompute);
+
+    delete[] offsets;
+}
+
+#endif /* SCAN_H */
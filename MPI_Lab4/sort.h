@@ -0,0 +1,154 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <mpich/mpi.h>
+#include <limits.h>
+#include <string.h>
+#include "../common/metrics.h"
+
+//sample sort of distributed array of int, result stays distributed:
+//every element of part of process i is not bigger than elements of part of process i+1
+//every process sorts its part with radix sort and takes regular samples of it,
+//all samples are gathered to all processes (MPI_Allgather) and give the same splitters,
+//parts are divided by splitters and sent to their processes (MPI_Alltoallv),
+//received sorted runs are sorted again
+
+const int sortRadixBits = 8;
+const int sortBuckets = 1 << sortRadixBits;
+const int sortSamples = 32; //regular samples from each process
+
+//LSD radix sort, passes where all elements have same digit are skipped
+//sign bit is inverted, so negative numbers go first
+static void RadixSort(int* arr, long size, int* temp) {
+    const int passes = 32 / sortRadixBits;
+    long counts[passes][sortBuckets];
+    memset(counts, 0, sizeof (counts));
+
+    //histograms of all digits in one pass
+    for (long i = 0; i < size; i++) {
+        unsigned int key = (unsigned int) arr[i] ^ 0x80000000u;
+        for (int p = 0; p < passes; p++) {
+            counts[p][(key >> (p * sortRadixBits)) & (sortBuckets - 1)]++;
+        }
+    }
+
+    int* src = arr;
+    int* dst = temp;
+    for (int p = 0; p < passes; p++) {
+        int shift = p * sortRadixBits;
+        if (size == 0 || counts[p][(((unsigned int) src[0] ^ 0x80000000u) >> shift) & (sortBuckets - 1)] == size) continue;
+
+        long offset = 0;
+        for (int d = 0; d < sortBuckets; d++) {
+            long count = counts[p][d];
+            counts[p][d] = offset;
+            offset += count;
+        }
+        for (long i = 0; i < size; i++) {
+            unsigned int key = (unsigned int) src[i] ^ 0x80000000u;
+            dst[counts[p][(key >> shift) & (sortBuckets - 1)]++] = src[i];
+        }
+
+        int* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != arr) memcpy(arr, src, size * sizeof (int));
+}
+
+//count of elements of sorted array not bigger than value
+static long UpperBound(const int* arr, long size, int value) {
+    long left = 0, right = size;
+    while (left < right) {
+        long middle = (left + right) / 2;
+        if (arr[middle] <= value) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+    return left;
+}
+
+//sorts distributed array, arr is part of this process (collective)
+//returns new sorted part of this process, its size is written to sortedSize
+static int* SampleSort(const int* arr, long size, long& sortedSize, MPI_Comm comm) {
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+
+    //sort own part
+    metrics.Start(phaseCompute);
+    int* local = new int[size + 1];
+    int* temp = new int[size + 1];
+    memcpy(local, arr, size * sizeof (int));
+    RadixSort(local, size, temp);
+    delete[] temp;
+
+    //regular samples, empty part gives maximal values
+    int samples[sortSamples];
+    for (int i = 0; i < sortSamples; i++) {
+        samples[i] = (size > 0) ? local[(i + 1) * size / (sortSamples + 1)] : INT_MAX;
+    }
+    metrics.Stop(phaseCompute);
+
+    //same splitters on all processes
+    metrics.Start(phaseBroadcast);
+    int* allSamples = new int[sortSamples * mpi_size];
+    MPI_Allgather(samples, sortSamples, MPI_INT, allSamples, sortSamples, MPI_INT, comm);
+    metrics.Stop(phaseBroadcast);
+    metrics.AddBytes(callAllgather, sortSamples * sizeof (int));
+
+    metrics.Start(phaseCompute);
+    temp = new int[sortSamples * mpi_size];
+    RadixSort(allSamples, sortSamples * mpi_size, temp);
+    delete[] temp;
+
+    //process i gets elements in (splitter i-1, splitter i]
+    int* sendCounts = new int[mpi_size];
+    int* sendDispls = new int[mpi_size];
+    long begin = 0;
+    for (int i = 0; i < mpi_size; i++) {
+        long end = (i < mpi_size - 1) ? UpperBound(local, size, allSamples[(i + 1) * sortSamples]) : size;
+        if (end < begin) end = begin;
+        sendCounts[i] = end - begin;
+        sendDispls[i] = begin;
+        begin = end;
+    }
+    delete[] allSamples;
+    metrics.Stop(phaseCompute);
+
+    //send parts to their processes
+    metrics.Start(phaseShift);
+    int* recvCounts = new int[mpi_size];
+    int* recvDispls = new int[mpi_size];
+    MPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT, comm);
+
+    sortedSize = 0;
+    for (int i = 0; i < mpi_size; i++) {
+        recvDispls[i] = sortedSize;
+        sortedSize += recvCounts[i];
+    }
+
+    int* sorted = new int[sortedSize + 1];
+    MPI_Alltoallv(local, sendCounts, sendDispls, MPI_INT, sorted, recvCounts, recvDispls, MPI_INT, comm);
+    metrics.Stop(phaseShift);
+    metrics.AddBytes(callAlltoall, size * sizeof (int));
+
+    //received runs are sorted, but radix sort doesn't need it
+    metrics.Start(phaseCompute);
+    temp = new int[sortedSize + 1];
+    RadixSort(sorted, sortedSize, temp);
+    delete[] temp;
+    metrics.Stop(phaseCompute);
+
+    delete[] local;
+    delete[] sendCounts;
+    delete[] sendDispls;
+    delete[] recvCounts;
+    delete[] recvDispls;
+    return sorted;
+}
+
+#endif /* SORT_H */
@@ -0,0 +1,348 @@
+#ifndef FIFO_H
+#define FIFO_H
+
+#include <mpich/mpi.h>
+#include <string.h>
+#include <stdint.h>
+#include "../common/metrics.h"
+
+typedef uint8_t byte;
+
+//distributed FIFO buffer in memory of all processes (MPI-3 RMA window)
+//elements are in rings of slots, every ring has head and tail counters changed with atomic operations
+//every slot has sequence number (as in bounded queue of D. Vyukov):
+//  seq == pos       - slot is free for element at position pos
+//  seq == pos + 1   - slot holds element at position pos
+//push and pop take constant count of one-sided operations and don't need other processes,
+//so any process can call them at any time
+//
+//global mode: one ring, slot of position pos is on process pos % mpi_size, counters are on process 0,
+//  order of all elements is kept, but all processes change counters of process 0
+//sharded mode: every process has its own ring (shard) with counters,
+//  push goes to shard of this process, or to next shards if it is full,
+//  pop takes from shard of this process, and if it is empty steals from other shards,
+//  order is kept only inside shard, but processes don't wait for each other while shards aren't empty
+//
+//slot holds message: bytes of message, count of elements, then size and data of every element
+//Push puts message with one element, PushBatch packs many elements to one message,
+//only used bytes of message are transferred
+//elements of popped message which are not returned yet are kept by process in pending message
+
+const int messageHeader = 8; //bytes and count of elements of message
+const int popPrefetch = 64; //bytes of message got by first MPI_Get, rest is got only for long messages
+
+enum FifoModes {
+    fifoGlobal, fifoSharded
+};
+
+class FIFO {
+public:
+    FIFO(int max_data_size, int slots_per_process, int batch_size = 0, FifoModes mode = fifoGlobal); //collective
+    ~FIFO(); //collective
+    bool Push(const void* data, int size); //put element to buffer, false if buffer is full
+    int Pop(byte* result); //get element from buffer, returns its size or -1 if buffer is empty
+    int PushBatch(const byte* data, const int* sizes, int count); //put elements, returns count of pushed elements
+    int PopBatch(byte* result, int* sizes, int max_count); //get elements of one message, returns their count
+    long Count(); //count of messages in all shards (can be changed by other processes at once)
+    long Capacity(); //max count of messages
+    int BatchSize(); //max bytes of elements with their sizes in one message
+private:
+    long AtomicGet(int rank, MPI_Aint disp);
+    void AtomicSet(int rank, MPI_Aint disp, long value);
+    long CompareAndSwap(int rank, MPI_Aint disp, long expected, long value);
+    void SlotOf(int shard, long pos, int& rank, MPI_Aint& seq_disp, MPI_Aint& data_disp);
+    bool PushMessage(); //puts message from stage to first shard which isn't full
+    bool PopMessage(); //gets message to pending from first shard which isn't empty
+    bool PushToShard(int shard);
+    bool PopFromShard(int shard);
+    void AddToStage(const void* data, int size);
+
+    MPI_Win win;
+    byte* memory; //local part of window
+    byte* stage; //message prepared for push (reused by all pushes)
+    int stage_bytes, stage_count;
+    byte* pending; //popped message
+    int pending_bytes, pending_count, pending_offset;
+    int mpi_rank, mpi_size;
+    int max_data_size; //max size of element
+    int batch_size;
+    int slots_per_process;
+    int slot_size; //size of message, aligned to 8 bytes
+    long capacity;
+    FifoModes mode;
+    int shards; //count of rings, counters of ring i are on process i
+    int home; //shard of this process
+    long ring_size; //slots in one ring
+    int next_victim; //shard where next stealing starts, so stealing processes don't all go to the same shard
+};
+
+//layout of window on every process: head, tail (of ring of this process), sequences of slots, slots
+const MPI_Aint head_disp = 0;
+const MPI_Aint tail_disp = sizeof (long);
+const MPI_Aint seqs_disp = 2 * sizeof (long);
+
+//batch_size is bytes for elements with their sizes in one message, by default one element of max size
+FIFO::FIFO(int max_data_size, int slots_per_process, int batch_size, FifoModes mode) {
+    MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
+
+    this->max_data_size = max_data_size;
+    this->batch_size = (batch_size > 4 + max_data_size) ? batch_size : 4 + max_data_size;
+    this->slots_per_process = slots_per_process;
+    slot_size = (messageHeader + this->batch_size + 7) / 8 * 8;
+    capacity = (long) slots_per_process * mpi_size;
+    this->mode = mode;
+    shards = (mode == fifoSharded) ? mpi_size : 1;
+    ring_size = (mode == fifoSharded) ? slots_per_process : capacity;
+    home = mpi_rank % shards;
+    next_victim = (mpi_rank + 1) % shards;
+    stage = new byte[slot_size];
+    pending = new byte[slot_size];
+    stage_bytes = messageHeader;
+    stage_count = 0;
+    pending_bytes = pending_count = pending_offset = 0;
+
+    MPI_Aint size = seqs_disp + (MPI_Aint) slots_per_process * (sizeof (long) + slot_size);
+    MPI_Win_allocate(size, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &memory, &win);
+    MPI_Win_lock_all(0, win);
+
+    //empty buffer: counters are 0, every slot waits for its first position
+    long* counters = (long*) memory;
+    counters[0] = counters[1] = 0;
+    long* seqs = (long*) (memory + seqs_disp);
+    for (int i = 0; i < slots_per_process; i++) {
+        seqs[i] = (mode == fifoSharded) ? i : (long) i * mpi_size + mpi_rank;
+    }
+    MPI_Win_sync(win);
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+FIFO::~FIFO() {
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+    delete[] stage;
+    delete[] pending;
+}
+
+long FIFO::AtomicGet(int rank, MPI_Aint disp) {
+    long value;
+    MPI_Fetch_and_op(NULL, &value, MPI_LONG, rank, disp, MPI_NO_OP, win);
+    MPI_Win_flush(rank, win);
+    return value;
+}
+
+//counters and sequences are changed only by atomic operations with one element
+void FIFO::AtomicSet(int rank, MPI_Aint disp, long value) {
+    long old;
+    MPI_Fetch_and_op(&value, &old, MPI_LONG, rank, disp, MPI_REPLACE, win);
+    MPI_Win_flush(rank, win);
+}
+
+//returns old value, value is set only if old value is expected
+long FIFO::CompareAndSwap(int rank, MPI_Aint disp, long expected, long value) {
+    long old;
+    MPI_Compare_and_swap(&value, &expected, &old, MPI_LONG, rank, disp, win);
+    MPI_Win_flush(rank, win);
+    return old;
+}
+
+void FIFO::SlotOf(int shard, long pos, int& rank, MPI_Aint& seq_disp, MPI_Aint& data_disp) {
+    long slot;
+    if (mode == fifoSharded) {
+        rank = shard;
+        slot = pos % slots_per_process;
+    } else {
+        rank = pos % mpi_size;
+        slot = (pos / mpi_size) % slots_per_process;
+    }
+    seq_disp = seqs_disp + slot * sizeof (long);
+    data_disp = seqs_disp + (MPI_Aint) slots_per_process * sizeof (long) + slot * slot_size;
+}
+
+void FIFO::AddToStage(const void* data, int size) {
+    memcpy(&(stage[stage_bytes]), &size, 4);
+    memcpy(&(stage[stage_bytes + 4]), data, size);
+    stage_bytes += 4 + size;
+    stage_count++;
+}
+
+bool FIFO::PushMessage() {
+    metrics.Start(phaseSend);
+    memcpy(stage, &stage_bytes, 4);
+    memcpy(&(stage[4]), &stage_count, 4);
+
+    //own shard first, then next ones
+    bool pushed = false;
+    for (int i = 0; i < shards && !pushed; i++) {
+        pushed = PushToShard((home + i) % shards);
+    }
+
+    metrics.Stop(phaseSend);
+    if (pushed) metrics.AddBytes(callPut, stage_bytes);
+    return pushed;
+}
+
+bool FIFO::PopMessage() {
+    metrics.Start(phaseReceive);
+
+    //own shard first, then steal from other shards
+    bool popped = PopFromShard(home);
+    for (int i = 0; i < shards && !popped; i++) {
+        int victim = (next_victim + i) % shards;
+        if (victim != home) popped = PopFromShard(victim);
+    }
+    next_victim = (next_victim + 1) % shards;
+
+    metrics.Stop(phaseReceive);
+    int first = (slot_size < popPrefetch) ? slot_size : popPrefetch;
+    if (popped) metrics.AddBytes(callGet, (pending_bytes > first) ? pending_bytes : first);
+    return popped;
+}
+
+bool FIFO::PushToShard(int shard) {
+    long pos = AtomicGet(shard, tail_disp);
+    while (true) {
+        int rank;
+        MPI_Aint seq_disp, data_disp;
+        SlotOf(shard, pos, rank, seq_disp, data_disp);
+        long seq = AtomicGet(rank, seq_disp);
+
+        //if slot still holds message of previous round, ring is full
+        if (seq < pos) return false;
+
+        if (seq == pos) {
+            //take position, if other process didn't take it before
+            long old = CompareAndSwap(shard, tail_disp, pos, pos + 1);
+            if (old == pos) {
+                //write used bytes of message, only then mark slot as full
+                MPI_Put(stage, stage_bytes, MPI_BYTE, rank, data_disp, stage_bytes, MPI_BYTE, win);
+                MPI_Win_flush(rank, win);
+                AtomicSet(rank, seq_disp, pos + 1);
+                return true;
+            }
+            pos = old;
+        } else {
+            //other process took position already
+            pos = AtomicGet(shard, tail_disp);
+        }
+    }
+}
+
+bool FIFO::PopFromShard(int shard) {
+    long pos = AtomicGet(shard, head_disp);
+    while (true) {
+        int rank;
+        MPI_Aint seq_disp, data_disp;
+        SlotOf(shard, pos, rank, seq_disp, data_disp);
+        long seq = AtomicGet(rank, seq_disp);
+
+        //if message at position isn't written yet, ring is empty
+        if (seq < pos + 1) return false;
+
+        if (seq == pos + 1) {
+            long old = CompareAndSwap(shard, head_disp, pos, pos + 1);
+            if (old == pos) {
+                //read beginning of message and rest of it if it is long, then free slot for next round
+                int first = (slot_size < popPrefetch) ? slot_size : popPrefetch;
+                MPI_Get(pending, first, MPI_BYTE, rank, data_disp, first, MPI_BYTE, win);
+                MPI_Win_flush(rank, win);
+                memcpy(&pending_bytes, pending, 4);
+                memcpy(&pending_count, &(pending[4]), 4);
+                if (pending_bytes > first) {
+                    MPI_Get(&(pending[first]), pending_bytes - first, MPI_BYTE, rank, data_disp + first, pending_bytes - first, MPI_BYTE, win);
+                    MPI_Win_flush(rank, win);
+                }
+                AtomicSet(rank, seq_disp, pos + ring_size);
+                pending_offset = messageHeader;
+                return true;
+            }
+            pos = old;
+        } else {
+            pos = AtomicGet(shard, head_disp);
+        }
+    }
+}
+
+bool FIFO::Push(const void* input, int size) {
+    if (size < 0 || size > max_data_size) return false;
+
+    stage_bytes = messageHeader;
+    stage_count = 0;
+    AddToStage(input, size);
+    return PushMessage();
+}
+
+int FIFO::Pop(byte* result) {
+    //take next element of popped message or pop new message
+    if (pending_count == 0 && !PopMessage()) return -1;
+
+    int size;
+    memcpy(&size, &(pending[pending_offset]), 4);
+    memcpy(result, &(pending[pending_offset + 4]), size);
+    pending_offset += 4 + size;
+    pending_count--;
+    return size;
+}
+
+//data holds elements one after another, elements are packed to messages of batch_size bytes
+int FIFO::PushBatch(const byte* data, const int* sizes, int count) {
+    int pushed = 0; //elements in pushed messages
+    long offset = 0;
+    stage_bytes = messageHeader;
+    stage_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (sizes[i] < 0 || sizes[i] > max_data_size) break;
+
+        //push full message and start next one
+        if (stage_bytes + 4 + sizes[i] > messageHeader + batch_size) {
+            if (!PushMessage()) return pushed;
+            pushed += stage_count;
+            stage_bytes = messageHeader;
+            stage_count = 0;
+        }
+        AddToStage(data + offset, sizes[i]);
+        offset += sizes[i];
+    }
+
+    if (stage_count > 0 && PushMessage()) pushed += stage_count;
+    return pushed;
+}
+
+//result gets elements one after another, it must have BatchSize() bytes
+int FIFO::PopBatch(byte* result, int* sizes, int max_count) {
+    if (pending_count == 0 && !PopMessage()) return 0;
+
+    int count = 0;
+    long offset = 0;
+    while (count < max_count && pending_count > 0) {
+        memcpy(&(sizes[count]), &(pending[pending_offset]), 4);
+        memcpy(result + offset, &(pending[pending_offset + 4]), sizes[count]);
+        offset += sizes[count];
+        pending_offset += 4 + sizes[count];
+        pending_count--;
+        count++;
+    }
+    return count;
+}
+
+long FIFO::Count() {
+    long count = 0;
+    for (int shard = 0; shard < shards; shard++) {
+        long head = AtomicGet(shard, head_disp);
+        long tail = AtomicGet(shard, tail_disp);
+        if (tail > head) count += tail - head;
+    }
+    return count;
+}
+
+long FIFO::Capacity() {
+    return capacity;
+}
+
+int FIFO::BatchSize() {
+    return batch_size;
+}
+
+#endif /* FIFO_H */
@@ -2,103 +2,9 @@
 #include <stdlib.h>
 #include <iostream>
 #include <string.h>
-#include <stdint.h>
-
-typedef uint8_t byte;
-
-enum TAGS {
-    tag_push = 10,
-    tag_pop = 11
-};
-
-
-class FIFO {
-public:
-    FIFO(int max_data_size); //constructor
-    bool Push(void* data, int size); //put element to puffer
-    int Pop(byte* result); //get element form buffer
-    int Count(); //count of elements
-private:
-    byte* data; //data of element
-    int mpi_rank, mpi_size; 
-    int cur_count; //cur elements count in buffer
-    int max_data_size; //max size of element
-};
-
-FIFO::FIFO(int max_data_size) {
-    MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
-
-    cur_count = 0;
-    data = new byte[max_data_size + 4];
-    this->max_data_size = max_data_size;
-}
-
-bool FIFO::Push(void* input, int size) {
-    //if there is no more space in buffer
-    if (cur_count == mpi_size) {
-        return false;
-    }
-    if (mpi_rank == 0) {
-        //copy size and data of element to temp memory
-        byte* buf = new byte[max_data_size + 4];
-        memcpy(buf, &size, 4);
-        memcpy(&(buf[4]), input, size);
-
-        //send new element to process with rank equal to current count of elements
-        if (cur_count > 0) {
-            MPI_Send(buf, max_data_size + 4, MPI_BYTE, cur_count, tag_push, MPI_COMM_WORLD);
-        //if its first element, just copy memory of process 0
-        } else {
-            memcpy(data, buf, max_data_size + 4);
-        }
-        delete buf;
-    //put element to process with rank equal to current count of elements
-    } else if (mpi_rank == cur_count) {
-        MPI_Recv(data, max_data_size + 4, MPI_BYTE, 0, tag_push, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    }
-    cur_count++;
-    MPI_Barrier(MPI_COMM_WORLD);
-    return true;
-}
-
-int FIFO::Pop(byte *result) {
-    //if there is no elements in buffer
-    if (cur_count == 0)
-        return -1;
-
-    if (mpi_rank == 0) {
-        //copy size and element data in process 0 memory to output
-        int size;
-        memcpy(&size, data, 4);
-        memcpy(result, &(data[4]), size);
-
-        //if there is more then 1 element, need shift all others elements to previous processes
-        //so wait for element from next process
-        if (cur_count > 1)
-            MPI_Recv(data, max_data_size, MPI_BYTE, 1, tag_pop, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        cur_count--;
-        MPI_Barrier(MPI_COMM_WORLD);
-        return size;
-    //last process with element sends it to previous process
-    } else if (mpi_rank == (cur_count - 1)) {
-        MPI_Send(data, max_data_size, MPI_BYTE, mpi_rank - 1, tag_pop, MPI_COMM_WORLD);
-    //all the others processes with elements send them to previous processes
-    //and receive elements from next process
-    } else if (mpi_rank < (cur_count - 1)) {
-        MPI_Send(data, max_data_size, MPI_BYTE, mpi_rank - 1, tag_pop, MPI_COMM_WORLD);
-        MPI_Recv(data, max_data_size, MPI_BYTE, mpi_rank + 1, tag_pop, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    }
-
-    cur_count--;
-    MPI_Barrier(MPI_COMM_WORLD);
-    return 0;
-}
-
-int FIFO::Count() {
-    return cur_count;
-}
+#include <unistd.h>
+#include "fifo.h"
+#include "../common/metrics.h"
 
 int main(int argc, char* argv[]) {
     int mpi_rank, mpi_size;
@@ -107,64 +13,154 @@ int main(int argc, char* argv[]) {
     MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
 
     int data_size = 100;
-    int pop_push_count = mpi_size + 2; //how many elements generate for test
+    int slots_per_process = 2; //messages stored on every process
+    int batch_size = 128; //bytes of elements with their sizes in one message
+    FifoModes mode = fifoGlobal;
+    long work_count = 1000; //elements pushed by every process in work queue test
+
+    int option;
+    opterr = mpi_rank == 0; //errors of options are printed once
+    while ((option = getopt(argc, argv, "m:n:")) != -1) {
+        switch (option) {
+            case 'm': mode = (strcmp(optarg, "sharded") == 0) ? fifoSharded : fifoGlobal;
+                break;
+            case 'n': work_count = atol(optarg);
+                break;
+            default:
+                if (mpi_rank == 0) std::cout << "\nUsage: mpi_lab5 [-m global|sharded] [-n elementsPerProcess]\n";
+                MPI_Finalize();
+                return 0;
+        }
+    }
 
-    FIFO* buffer = new FIFO(data_size);
+    FIFO* buffer = new FIFO(data_size, slots_per_process, batch_size, mode);
+    long pop_push_count = buffer->Capacity() + 2; //how many elements generate for test
 
+    //only process 0 works with buffer, memory of other processes is used by one-sided operations
     if (mpi_rank == 0) {
-        std::cout << "Max elements in buffer = " << mpi_size << "\n";
+        std::cout << "Max elements in buffer = " << buffer->Capacity() << "\n";
         std::cout << "Max data size = " << data_size << "\n";
-    }
-
-    //generate and push some elements
-    for (int i = 0; i < pop_push_count; i++) {
-        int n;
-        char* input;
 
-        //generate data
-        if (mpi_rank == 0) {
-            n = rand() % 3 + 2;
-            input = new char[n + 1];
-
-            for (int i = 0; i < n; i++) {
-                input[i] = rand() % 25 + 65;
+        //generate and push some elements
+        for (long i = 0; i < pop_push_count; i++) {
+            //generate data
+            int n = rand() % 3 + 2;
+            char* input = new char[n + 1];
+            for (int j = 0; j < n; j++) {
+                input[j] = rand() % 25 + 65;
             }
             input[n] = '\0';
-        }
 
-        //push to buffer
-        bool flag = buffer->Push(&input, n);
+            //push to buffer with terminating zero
+            bool flag = buffer->Push(input, n + 1);
 
-        //print result
-        if (mpi_rank == 0) {
+            //print result
             if (flag)
                 std::cout << "Push data: " << input << ". Elements in buffer = " << buffer->Count() << "\n";
             else
                 std::cout << "Push data. " << input << ". Cant push. Elements in buffer = " << buffer->Count() << "\n";
+            delete[] input;
         }
-    }
 
-    //pop some elements
-    for (int i = 0; i < pop_push_count; i++) {
+        //pop some elements
+        byte* result = new byte[data_size];
+        for (long i = 0; i < pop_push_count; i++) {
+            //pop from buffer
+            int result_size = buffer->Pop(result);
 
-        int result_size;
-        byte *result = new byte[data_size];
-        
-        //pop from puffer
-        result_size = buffer->Pop(result);
-
-        //print result
-        if (mpi_rank == 0) {
+            //print result
             if (result_size == -1)
                 std::cout << "Pop data. Cant pop. Elements in buffer = " << buffer->Count() << "\n";
-            else {
-                char* output;
-                memcpy(&output, result, result_size);
-                std::cout << "Pop data: " << output << ". Size = " << result_size << ". Elements in buffer = " << buffer->Count() << "\n";
+            else
+                std::cout << "Pop data: " << (char*) result << ". Size = " << result_size - 1 << ". Elements in buffer = " << buffer->Count() << "\n";
+        }
+
+        //push elements in batches, small elements are packed to one message
+        int batch_count = 5;
+        byte* batch = new byte[batch_count * 5];
+        int* sizes = new int[batch_count];
+        for (int b = 0; b < 2; b++) {
+            long offset = 0;
+            for (int i = 0; i < batch_count; i++) {
+                int n = rand() % 3 + 2;
+                for (int j = 0; j < n; j++) {
+                    batch[offset + j] = rand() % 25 + 65;
+                }
+                batch[offset + n] = '\0';
+                sizes[i] = n + 1;
+                offset += n + 1;
+            }
+
+            int pushed = buffer->PushBatch(batch, sizes, batch_count);
+            std::cout << "Push batch: " << pushed << " of " << batch_count << " elements. Messages in buffer = " << buffer->Count() << "\n";
+        }
+        delete[] batch;
+        delete[] sizes;
+
+        //pop batches, every batch is elements of one message
+        byte* batch_result = new byte[buffer->BatchSize()];
+        int* result_sizes = new int[batch_count];
+        while (true) {
+            int popped = buffer->PopBatch(batch_result, result_sizes, batch_count);
+            if (popped == 0) break;
+
+            std::cout << "Pop batch:";
+            long offset = 0;
+            for (int i = 0; i < popped; i++) {
+                std::cout << " " << (char*) (batch_result + offset);
+                offset += result_sizes[i];
+            }
+            std::cout << ". Messages in buffer = " << buffer->Count() << "\n";
+        }
+        delete[] batch_result;
+        delete[] result_sizes;
+        delete[] result;
+    }
+
+    //work queue: every process pushes its elements and pops elements of any process at the same time
+    MPI_Barrier(MPI_COMM_WORLD);
+    double tStart = MPI_Wtime();
+    long counts[4] = {0, 0, 0, 0}; //pushed, popped, sum of pushed, sum of popped
+    long item;
+    for (long i = 0; i < work_count; i++) {
+        item = mpi_rank * work_count + i;
+
+        //if buffer is full, process works as consumer until there is place
+        while (!buffer->Push(&item, sizeof (item))) {
+            if (buffer->Pop((byte*) & item) >= 0) {
+                counts[1]++;
+                counts[3] += item;
             }
+            item = mpi_rank * work_count + i;
         }
+        counts[0]++;
+        counts[2] += item;
+
+        if (i % 2 == 1 && buffer->Pop((byte*) & item) >= 0) {
+            counts[1]++;
+            counts[3] += item;
+        }
+    }
+
+    //all pushes are done, take the rest
+    MPI_Barrier(MPI_COMM_WORLD);
+    while (buffer->Pop((byte*) & item) >= 0) {
+        counts[1]++;
+        counts[3] += item;
+    }
+    double tWork = MPI_Wtime() - tStart;
+
+    long total[4];
+    MPI_Reduce(counts, total, 4, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (mpi_rank == 0) {
+        std::cout << "\nWork queue (" << ((mode == fifoSharded) ? "sharded" : "global") << "): pushed " << total[0]
+                << ", popped " << total[1] << ((total[0] == total[1] && total[2] == total[3]) ? ", all elements popped once" : ", ERROR: elements lost")
+                << ". Time taken: " << tWork << "\n";
     }
 
+    delete buffer;
+
+    metrics.Report("lab5", MPI_COMM_WORLD);
     MPI_Finalize();
     return 0;
 }
@@ -0,0 +1,270 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <mpich/mpi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+#include "kernel.h"
+#include "summa.h"
+#include "../common/metrics.h"
+
+//batch of independent multiplications of pairs of square matrices of different ranks
+//jobs are given by list of items "count x rank" or "rank", for example 8x64,2x600
+//large jobs (rank from batchSpreadRank) are multiplied by all processes with SUMMA one after another
+//limitation: large jobs are not overlapped, process 0 generates next job only after SUMMA of current job
+//(it takes part in SUMMA and MultiplySumma scatters full matrices from it), so other processes wait for
+//generation and scatter of every large job; only small jobs below are double-buffered
+//small jobs are packed: every process multiplies whole job by its threads,
+//jobs go in rounds of one job per process in order of list
+//process 0 generates next round and scatters it (MPI_Iscatterv) while all processes multiply current round,
+//results of round are gathered (MPI_Igatherv) while next round is multiplied
+//so processes are started once for all jobs and don't wait for generation and transfers between small jobs
+
+const int batchSpreadRank = 512; //jobs from this rank are divided between all processes
+const long batchMaxJobs = 1 << 20;
+
+struct BatchJob {
+    int rank;
+    unsigned seed; //matrices of job are generated from own seed, so they can be generated again for check
+};
+
+//reads one item of list and moves to next one
+static bool ParseBatchItem(const char*& list, long& count, long& rank) {
+    char* end;
+    long value = strtol(list, &end, 10);
+    if (end == list || value <= 0) return false;
+
+    count = 1;
+    rank = value;
+    if (*end == 'x') {
+        count = value;
+        list = end + 1;
+        rank = strtol(list, &end, 10);
+        if (end == list || rank <= 0 || rank > 1 << 15) return false;
+    }
+
+    list = end;
+    if (*list == ',') list++;
+    else if (*list != '\0') return false;
+    return true;
+}
+
+//returns count of jobs or -1 if list is not correct
+static int ParseBatchJobs(const char* list, BatchJob*& jobs) {
+    long count = 0, times, rank;
+    for (const char* item = list; *item != '\0';) {
+        if (!ParseBatchItem(item, times, rank)) return -1;
+        count += times;
+        if (count > batchMaxJobs) return -1;
+    }
+    if (count == 0) return -1;
+
+    jobs = new BatchJob[count];
+    int j = 0;
+    for (const char* item = list; *item != '\0';) {
+        ParseBatchItem(item, times, rank);
+        for (long t = 0; t < times; t++, j++) {
+            jobs[j].rank = rank;
+            jobs[j].seed = j + 1;
+        }
+    }
+    return count;
+}
+
+//element of matrix from random number of [0, RAND_MAX]: integers are from [0, maxNumsInMatrix),
+//floating point numbers from [0, maxNumsInMatrix] and have fractional part, so their products are rounded
+template <typename T>
+static T RandomElement(int random, int maxNumsInMatrix) {
+    typedef typename Element<T>::Acc Acc;
+    if (std::numeric_limits<Acc>::is_integer) return Element<T>::FromAcc((Acc) (random % maxNumsInMatrix));
+    return Element<T>::FromAcc((Acc) random / (Acc) RAND_MAX * (Acc) maxNumsInMatrix);
+}
+
+//matrices A and B (transposed) of job, same for every call
+template <typename T>
+static void GenerateJob(const BatchJob& job, int maxNumsInMatrix, T* matrixA, T* matrixB) {
+    unsigned seed = job.seed;
+    long size = (long) job.rank * job.rank;
+    for (long i = 0; i < size; i++) {
+        matrixA[i] = RandomElement<T>(rand_r(&seed), maxNumsInMatrix);
+        matrixB[i] = RandomElement<T>(rand_r(&seed), maxNumsInMatrix);
+    }
+}
+
+//process 0 copies gathered round of small jobs to results of jobs
+template <typename A>
+static void CopyRound(int round, const int* small, int smallCount, const A* gathered, const int* counts, const int* displs, A** results, int mpi_size) {
+    for (int i = 0; i < mpi_size; i++) {
+        int s = round * mpi_size + i;
+        if (s < smallCount) memcpy(results[small[s]], gathered + displs[i], counts[i] * sizeof (A));
+    }
+}
+
+//multiplies all jobs, results[j] is matrix C of job j on process 0 of comm
+//if results is NULL, matrices C are gathered and dropped
+template <typename T>
+static void MultiplyBatch(const BatchJob* jobs, int count, int maxNumsInMatrix, typename Element<T>::Acc** results, MPI_Comm comm) {
+    typedef typename Element<T>::Acc Acc;
+    MPI_Datatype type = Element<T>::Type(), accType = Element<Acc>::Type();
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+
+    //large jobs, all processes multiply them together
+    int maxLarge = 0, maxSmall = 0, smallCount = 0;
+    for (int j = 0; j < count; j++) {
+        if (jobs[j].rank >= batchSpreadRank) {
+            if (jobs[j].rank > maxLarge) maxLarge = jobs[j].rank;
+        } else {
+            if (jobs[j].rank > maxSmall) maxSmall = jobs[j].rank;
+            smallCount++;
+        }
+    }
+
+    if (maxLarge > 0) {
+        long size = (long) maxLarge * maxLarge;
+        T *matrixA = NULL, *matrixB = NULL;
+        Acc* scratchC = NULL;
+        if (mpi_rank == 0) {
+            matrixA = new T[size];
+            matrixB = new T[size];
+            if (results == NULL) scratchC = new Acc[size];
+        }
+        for (int j = 0; j < count; j++) {
+            if (jobs[j].rank < batchSpreadRank) continue;
+            if (mpi_rank == 0) {
+                metrics.Start(phaseGenerate);
+                GenerateJob(jobs[j], maxNumsInMatrix, matrixA, matrixB);
+                metrics.Stop(phaseGenerate);
+            }
+            MultiplySumma(matrixA, matrixB, (results != NULL) ? results[j] : scratchC, jobs[j].rank, comm, NULL);
+        }
+        if (mpi_rank == 0) {
+            delete[] matrixA;
+            delete[] matrixB;
+            if (scratchC != NULL) delete[] scratchC;
+        }
+    }
+    if (smallCount == 0) return;
+
+    //small jobs in order of list, round r gives job small[r * mpi_size + i] to process i
+    int* small = new int[smallCount];
+    for (int j = 0, s = 0; j < count; j++) {
+        if (jobs[j].rank < batchSpreadRank) small[s++] = j;
+    }
+    int rounds = (smallCount + mpi_size - 1) / mpi_size;
+
+    //two slots: transfers of one round go while other round is multiplied
+    long maxElements = (long) maxSmall * maxSmall;
+    T* sendBuffers[2] = {NULL, NULL};
+    Acc* gatherBuffers[2] = {NULL, NULL};
+    T* recvBuffers[2];
+    Acc* resultBuffers[2];
+    int* counts[2][2]; //counts and displacements of scatter and gather
+    int* displs[2][2];
+    int gatheredRound[2] = {-1, -1};
+    MPI_Request scatterRequests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    MPI_Request gatherRequests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    for (int b = 0; b < 2; b++) {
+        recvBuffers[b] = AllocateTouched<T>(2 * maxElements);
+        resultBuffers[b] = AllocateTouched<Acc>(maxElements);
+        if (mpi_rank == 0) {
+            sendBuffers[b] = new T[2 * maxElements * mpi_size];
+            gatherBuffers[b] = new Acc[maxElements * mpi_size];
+        }
+        for (int k = 0; k < 2; k++) {
+            counts[b][k] = new int[mpi_size];
+            displs[b][k] = new int[mpi_size];
+        }
+    }
+
+    for (int r = 0; r <= rounds; r++) {
+        int cur = r % 2, prev = (r + 1) % 2;
+
+        //generate and start scattering round r
+        if (r < rounds) {
+            int displ = 0;
+            for (int i = 0; i < mpi_size; i++) {
+                int s = r * mpi_size + i;
+                int elements = (s < smallCount) ? jobs[small[s]].rank * jobs[small[s]].rank : 0;
+                counts[cur][0][i] = 2 * elements;
+                displs[cur][0][i] = 2 * displ;
+
+                //A and B of job are packed one after another
+                if (mpi_rank == 0 && elements > 0) {
+                    metrics.Start(phaseGenerate);
+                    T* packed = sendBuffers[cur] + 2L * displ;
+                    GenerateJob(jobs[small[s]], maxNumsInMatrix, packed, packed + elements);
+                    metrics.Stop(phaseGenerate);
+                }
+                displ += elements;
+            }
+            metrics.AddBytes(callScatter, counts[cur][0][mpi_rank] * sizeof (T));
+            MPI_Iscatterv(sendBuffers[cur], counts[cur][0], displs[cur][0], type,
+                    recvBuffers[cur], counts[cur][0][mpi_rank], type, 0, comm, &scatterRequests[cur]);
+        }
+
+        //multiply round r-1 while round r is sent
+        if (r > 0) {
+            metrics.Start(phaseScatter);
+            MPI_Wait(&scatterRequests[prev], MPI_STATUS_IGNORE);
+            metrics.Stop(phaseScatter);
+
+            //round k uses slot k % 2 and its gather is started in iteration k + 1,
+            //so slot of round r-1 still holds gather of round r-3 started in iteration r-2:
+            //result buffer and gather counts of slot are reused only when that gather is finished
+            if (gatheredRound[prev] >= 0) {
+                metrics.Start(phaseGather);
+                MPI_Wait(&gatherRequests[prev], MPI_STATUS_IGNORE);
+                metrics.Stop(phaseGather);
+                if (mpi_rank == 0 && results != NULL) {
+                    CopyRound(gatheredRound[prev], small, smallCount, gatherBuffers[prev], counts[prev][1], displs[prev][1], results, mpi_size);
+                }
+            }
+
+            int s = (r - 1) * mpi_size + mpi_rank;
+            if (s < smallCount) {
+                int rank = jobs[small[s]].rank;
+                metrics.Start(phaseCompute);
+                MultiplyBlock(recvBuffers[prev], rank, recvBuffers[prev] + (long) rank * rank, rank, resultBuffers[prev], rank, rank, rank, rank);
+                metrics.Stop(phaseCompute);
+            }
+
+            for (int i = 0; i < mpi_size; i++) {
+                counts[prev][1][i] = counts[prev][0][i] / 2;
+                displs[prev][1][i] = displs[prev][0][i] / 2;
+            }
+            metrics.AddBytes(callGather, counts[prev][1][mpi_rank] * sizeof (Acc));
+            MPI_Igatherv(resultBuffers[prev], counts[prev][1][mpi_rank], accType,
+                    gatherBuffers[prev], counts[prev][1], displs[prev][1], accType, 0, comm, &gatherRequests[prev]);
+            gatheredRound[prev] = r - 1;
+        }
+    }
+
+    //results of last rounds
+    metrics.Start(phaseGather);
+    MPI_Waitall(2, gatherRequests, MPI_STATUSES_IGNORE);
+    metrics.Stop(phaseGather);
+    for (int b = 0; b < 2; b++) {
+        if (mpi_rank == 0 && results != NULL && gatheredRound[b] >= 0) {
+            CopyRound(gatheredRound[b], small, smallCount, gatherBuffers[b], counts[b][1], displs[b][1], results, mpi_size);
+        }
+    }
+
+    for (int b = 0; b < 2; b++) {
+        delete[] recvBuffers[b];
+        delete[] resultBuffers[b];
+        if (mpi_rank == 0) {
+            delete[] sendBuffers[b];
+            delete[] gatherBuffers[b];
+        }
+        for (int k = 0; k < 2; k++) {
+            delete[] counts[b][k];
+            delete[] displs[b][k];
+        }
+    }
+    delete[] small;
+}
+
+#endif /* BATCH_H */
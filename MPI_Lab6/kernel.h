@@ -0,0 +1,453 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <string.h>
+#include "../common/element.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+//local matrix multiplication kernel
+//computes C = A * B for blocks of matrices, where
+//A is rows x depth, B is cols x depth (matrix B is transposed!), C is rows x cols
+//element (i, j) of C is dot product of row i of A and row j of B
+//kernel is template of type of elements T, blocks of A and B are packed with conversion to type of
+//calculations Element<T>::Acc (float for fp16 and bf16, long for int32), C has elements of type Acc
+//int32, float and double have their own vectorized tiles, int64 has only portable tile
+
+//sizes of cache blocks
+const int blockRows = 64; //rows of A packed at once (fits L2 with block of B)
+const int blockCols = 128; //rows of B packed at once
+const int blockDepth = 512; //length of packed rows (tile of A and B fits L1)
+
+//sizes of register tile: tileRows rows of A x tileCols rows of B
+const int tileRows = 2;
+const int tileCols = 4;
+
+//adds to tile of C products of packed rows of A and B
+//a and b hold rows with length depth one after another, ldc is row length of C
+template <typename A>
+using TileFunc = void (*)(const A* a, const A* b, int depth, A* c, int ldc);
+
+//portable tile for any sizes (used for edges of blocks and as fallback)
+template <typename A>
+static void TileEdge(const A* a, const A* b, int depth, A* c, int ldc, int rows, int cols) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            const A* rowA = a + i * depth;
+            const A* rowB = b + j * depth;
+            A sum = 0;
+            for (int k = 0; k < depth; k++) {
+                sum += rowA[k] * rowB[k];
+            }
+            c[i * ldc + j] += sum;
+        }
+    }
+}
+
+//portable full tile, keeps all tile sums in registers
+template <typename A>
+static void TileScalar(const A* a, const A* b, int depth, A* c, int ldc) {
+    const A *a0 = a, *a1 = a + depth;
+    const A *b0 = b, *b1 = b + depth, *b2 = b + 2 * depth, *b3 = b + 3 * depth;
+    A c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+    A c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+
+    for (int k = 0; k < depth; k++) {
+        c00 += a0[k] * b0[k];
+        c01 += a0[k] * b1[k];
+        c02 += a0[k] * b2[k];
+        c03 += a0[k] * b3[k];
+        c10 += a1[k] * b0[k];
+        c11 += a1[k] * b1[k];
+        c12 += a1[k] * b2[k];
+        c13 += a1[k] * b3[k];
+    }
+
+    c[0] += c00; c[1] += c01; c[2] += c02; c[3] += c03;
+    c[ldc] += c10; c[ldc + 1] += c11; c[ldc + 2] += c12; c[ldc + 3] += c13;
+}
+
+//adds rest of rows from k and sums of vectors of tile to C
+template <typename A>
+static inline void FinishTile(A sums[tileRows][tileCols], const A* a, const A* b, int k, int depth, A* c, int ldc) {
+    for (; k < depth; k++) {
+        for (int j = 0; j < tileCols; j++) {
+            sums[0][j] += a[k] * b[j * depth + k];
+            sums[1][j] += a[depth + k] * b[j * depth + k];
+        }
+    }
+
+    for (int j = 0; j < tileCols; j++) {
+        c[j] += sums[0][j];
+        c[ldc + j] += sums[1][j];
+    }
+}
+
+#ifdef KERNEL_X86
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline long HorizontalSumAvx2(__m256i v) {
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+    return _mm_cvtsi128_si64(sum);
+}
+
+//int32 elements packed to long: 4 elements of row per step,
+//_mm256_mul_epi32 multiplies low 32 bits of 64 bit lanes to 64 bit products, so sums don't overflow
+//(only for values of int32, products of int64 have no AVX2 instruction)
+static void TileAvx2(const long* a, const long* b, int depth, long* c, int ldc) {
+    const long *a0 = a, *a1 = a + depth;
+    const long *b0 = b, *b1 = b + depth, *b2 = b + 2 * depth, *b3 = b + 3 * depth;
+    __m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00;
+    __m256i c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+
+    int k = 0;
+    for (; k + 4 <= depth; k += 4) {
+        __m256i va0 = _mm256_loadu_si256((const __m256i*) (a0 + k));
+        __m256i va1 = _mm256_loadu_si256((const __m256i*) (a1 + k));
+        __m256i vb = _mm256_loadu_si256((const __m256i*) (b0 + k));
+        c00 = _mm256_add_epi64(c00, _mm256_mul_epi32(va0, vb));
+        c10 = _mm256_add_epi64(c10, _mm256_mul_epi32(va1, vb));
+        vb = _mm256_loadu_si256((const __m256i*) (b1 + k));
+        c01 = _mm256_add_epi64(c01, _mm256_mul_epi32(va0, vb));
+        c11 = _mm256_add_epi64(c11, _mm256_mul_epi32(va1, vb));
+        vb = _mm256_loadu_si256((const __m256i*) (b2 + k));
+        c02 = _mm256_add_epi64(c02, _mm256_mul_epi32(va0, vb));
+        c12 = _mm256_add_epi64(c12, _mm256_mul_epi32(va1, vb));
+        vb = _mm256_loadu_si256((const __m256i*) (b3 + k));
+        c03 = _mm256_add_epi64(c03, _mm256_mul_epi32(va0, vb));
+        c13 = _mm256_add_epi64(c13, _mm256_mul_epi32(va1, vb));
+    }
+
+    long sums[tileRows][tileCols] = {
+        {HorizontalSumAvx2(c00), HorizontalSumAvx2(c01), HorizontalSumAvx2(c02), HorizontalSumAvx2(c03)},
+        {HorizontalSumAvx2(c10), HorizontalSumAvx2(c11), HorizontalSumAvx2(c12), HorizontalSumAvx2(c13)}
+    };
+    FinishTile(sums, a, b, k, depth, c, ldc);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+static inline float HorizontalSumAvx2(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+static inline double HorizontalSumAvx2(__m256d v) {
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+    return _mm_cvtsd_f64(sum);
+}
+
+//8 elements of row per step with fused multiply-add
+static void TileAvx2(const float* a, const float* b, int depth, float* c, int ldc) {
+    const float *a0 = a, *a1 = a + depth;
+    const float *b0 = b, *b1 = b + depth, *b2 = b + 2 * depth, *b3 = b + 3 * depth;
+    __m256 c00 = _mm256_setzero_ps(), c01 = c00, c02 = c00, c03 = c00;
+    __m256 c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+
+    int k = 0;
+    for (; k + 8 <= depth; k += 8) {
+        __m256 va0 = _mm256_loadu_ps(a0 + k);
+        __m256 va1 = _mm256_loadu_ps(a1 + k);
+        __m256 vb = _mm256_loadu_ps(b0 + k);
+        c00 = _mm256_fmadd_ps(va0, vb, c00);
+        c10 = _mm256_fmadd_ps(va1, vb, c10);
+        vb = _mm256_loadu_ps(b1 + k);
+        c01 = _mm256_fmadd_ps(va0, vb, c01);
+        c11 = _mm256_fmadd_ps(va1, vb, c11);
+        vb = _mm256_loadu_ps(b2 + k);
+        c02 = _mm256_fmadd_ps(va0, vb, c02);
+        c12 = _mm256_fmadd_ps(va1, vb, c12);
+        vb = _mm256_loadu_ps(b3 + k);
+        c03 = _mm256_fmadd_ps(va0, vb, c03);
+        c13 = _mm256_fmadd_ps(va1, vb, c13);
+    }
+
+    float sums[tileRows][tileCols] = {
+        {HorizontalSumAvx2(c00), HorizontalSumAvx2(c01), HorizontalSumAvx2(c02), HorizontalSumAvx2(c03)},
+        {HorizontalSumAvx2(c10), HorizontalSumAvx2(c11), HorizontalSumAvx2(c12), HorizontalSumAvx2(c13)}
+    };
+    FinishTile(sums, a, b, k, depth, c, ldc);
+}
+
+//4 elements of row per step with fused multiply-add
+static void TileAvx2(const double* a, const double* b, int depth, double* c, int ldc) {
+    const double *a0 = a, *a1 = a + depth;
+    const double *b0 = b, *b1 = b + depth, *b2 = b + 2 * depth, *b3 = b + 3 * depth;
+    __m256d c00 = _mm256_setzero_pd(), c01 = c00, c02 = c00, c03 = c00;
+    __m256d c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+
+    int k = 0;
+    for (; k + 4 <= depth; k += 4) {
+        __m256d va0 = _mm256_loadu_pd(a0 + k);
+        __m256d va1 = _mm256_loadu_pd(a1 + k);
+        __m256d vb = _mm256_loadu_pd(b0 + k);
+        c00 = _mm256_fmadd_pd(va0, vb, c00);
+        c10 = _mm256_fmadd_pd(va1, vb, c10);
+        vb = _mm256_loadu_pd(b1 + k);
+        c01 = _mm256_fmadd_pd(va0, vb, c01);
+        c11 = _mm256_fmadd_pd(va1, vb, c11);
+        vb = _mm256_loadu_pd(b2 + k);
+        c02 = _mm256_fmadd_pd(va0, vb, c02);
+        c12 = _mm256_fmadd_pd(va1, vb, c12);
+        vb = _mm256_loadu_pd(b3 + k);
+        c03 = _mm256_fmadd_pd(va0, vb, c03);
+        c13 = _mm256_fmadd_pd(va1, vb, c13);
+    }
+
+    double sums[tileRows][tileCols] = {
+        {HorizontalSumAvx2(c00), HorizontalSumAvx2(c01), HorizontalSumAvx2(c02), HorizontalSumAvx2(c03)},
+        {HorizontalSumAvx2(c10), HorizontalSumAvx2(c11), HorizontalSumAvx2(c12), HorizontalSumAvx2(c13)}
+    };
+    FinishTile(sums, a, b, k, depth, c, ldc);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,fma")
+
+//halves of 512 bit vector are summed by AVX2 helpers
+//(masked extracts with zero source, plain extracts and casts of GCC give -Wuninitialized)
+static inline __m256i LowHalfAvx512(__m512i v) {
+    return _mm512_mask_extracti64x4_epi64(_mm256_setzero_si256(), (__mmask8) -1, v, 0);
+}
+
+static inline __m256i HighHalfAvx512(__m512i v) {
+    return _mm512_mask_extracti64x4_epi64(_mm256_setzero_si256(), (__mmask8) -1, v, 1);
+}
+
+static inline long HorizontalSumAvx512(__m512i v) {
+    return HorizontalSumAvx2(_mm256_add_epi64(LowHalfAvx512(v), HighHalfAvx512(v)));
+}
+
+static inline float HorizontalSumAvx512(__m512 v) {
+    __m512i bits = _mm512_castps_si512(v);
+    return HorizontalSumAvx2(_mm256_add_ps(_mm256_castsi256_ps(LowHalfAvx512(bits)), _mm256_castsi256_ps(HighHalfAvx512(bits))));
+}
+
+//products of low 32 bits of 64 bit lanes (zero masked form for same reason as extracts above)
+static inline __m512i MultiplyLowAvx512(__m512i a, __m512i b) {
+    return _mm512_maskz_mul_epi32((__mmask8) -1, a, b);
+}
+
+//int32 elements packed to long: 8 elements of row per step, products as in TileAvx2
+static void TileAvx512(const long* a, const long* b, int depth, long* c, int ldc) {
+    const long *a0 = a, *a1 = a + depth;
+    const long *b0 = b, *b1 = b + depth, *b2 = b + 2 * depth, *b3 = b + 3 * depth;
+    __m512i c00 = _mm512_setzero_si512(), c01 = c00, c02 = c00, c03 = c00;
+    __m512i c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+
+    int k = 0;
+    for (; k + 8 <= depth; k += 8) {
+        __m512i va0 = _mm512_loadu_si512(a0 + k);
+        __m512i va1 = _mm512_loadu_si512(a1 + k);
+        __m512i vb = _mm512_loadu_si512(b0 + k);
+        c00 = _mm512_add_epi64(c00, MultiplyLowAvx512(va0, vb));
+        c10 = _mm512_add_epi64(c10, MultiplyLowAvx512(va1, vb));
+        vb = _mm512_loadu_si512(b1 + k);
+        c01 = _mm512_add_epi64(c01, MultiplyLowAvx512(va0, vb));
+        c11 = _mm512_add_epi64(c11, MultiplyLowAvx512(va1, vb));
+        vb = _mm512_loadu_si512(b2 + k);
+        c02 = _mm512_add_epi64(c02, MultiplyLowAvx512(va0, vb));
+        c12 = _mm512_add_epi64(c12, MultiplyLowAvx512(va1, vb));
+        vb = _mm512_loadu_si512(b3 + k);
+        c03 = _mm512_add_epi64(c03, MultiplyLowAvx512(va0, vb));
+        c13 = _mm512_add_epi64(c13, MultiplyLowAvx512(va1, vb));
+    }
+
+    long sums[tileRows][tileCols] = {
+        {HorizontalSumAvx512(c00), HorizontalSumAvx512(c01), HorizontalSumAvx512(c02), HorizontalSumAvx512(c03)},
+        {HorizontalSumAvx512(c10), HorizontalSumAvx512(c11), HorizontalSumAvx512(c12), HorizontalSumAvx512(c13)}
+    };
+    FinishTile(sums, a, b, k, depth, c, ldc);
+}
+
+//16 elements of row per step with fused multiply-add
+static void TileAvx512(const float* a, const float* b, int depth, float* c, int ldc) {
+    const float *a0 = a, *a1 = a + depth;
+    const float *b0 = b, *b1 = b + depth, *b2 = b + 2 * depth, *b3 = b + 3 * depth;
+    __m512 c00 = _mm512_setzero_ps(), c01 = c00, c02 = c00, c03 = c00;
+    __m512 c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+
+    int k = 0;
+    for (; k + 16 <= depth; k += 16) {
+        __m512 va0 = _mm512_loadu_ps(a0 + k);
+        __m512 va1 = _mm512_loadu_ps(a1 + k);
+        __m512 vb = _mm512_loadu_ps(b0 + k);
+        c00 = _mm512_fmadd_ps(va0, vb, c00);
+        c10 = _mm512_fmadd_ps(va1, vb, c10);
+        vb = _mm512_loadu_ps(b1 + k);
+        c01 = _mm512_fmadd_ps(va0, vb, c01);
+        c11 = _mm512_fmadd_ps(va1, vb, c11);
+        vb = _mm512_loadu_ps(b2 + k);
+        c02 = _mm512_fmadd_ps(va0, vb, c02);
+        c12 = _mm512_fmadd_ps(va1, vb, c12);
+        vb = _mm512_loadu_ps(b3 + k);
+        c03 = _mm512_fmadd_ps(va0, vb, c03);
+        c13 = _mm512_fmadd_ps(va1, vb, c13);
+    }
+
+    float sums[tileRows][tileCols] = {
+        {HorizontalSumAvx512(c00), HorizontalSumAvx512(c01), HorizontalSumAvx512(c02), HorizontalSumAvx512(c03)},
+        {HorizontalSumAvx512(c10), HorizontalSumAvx512(c11), HorizontalSumAvx512(c12), HorizontalSumAvx512(c13)}
+    };
+    FinishTile(sums, a, b, k, depth, c, ldc);
+}
+
+#pragma GCC pop_options
+
+#endif
+
+//chooses best tile for current processor and type of elements T (once)
+//int64 has only portable tile, there is no multiplication of 64 bit integers in AVX2
+template <typename T>
+static TileFunc<typename Element<T>::Acc> SelectTile() {
+    return TileScalar<typename Element<T>::Acc>;
+}
+
+template <>
+TileFunc<long> SelectTile<int>() {
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return TileAvx512;
+    if (__builtin_cpu_supports("avx2")) return TileAvx2;
+#endif
+    return TileScalar<long>;
+}
+
+template <>
+TileFunc<float> SelectTile<float>() {
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return TileAvx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return TileAvx2;
+#endif
+    return TileScalar<float>;
+}
+
+template <>
+TileFunc<double> SelectTile<double>() {
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return TileAvx2;
+#endif
+    return TileScalar<double>;
+}
+
+template <>
+TileFunc<float> SelectTile<float16>() {
+    return SelectTile<float>();
+}
+
+template <>
+TileFunc<float> SelectTile<bfloat16>() {
+    return SelectTile<float>();
+}
+
+//copies block of rows with length depth starting from column k0 to continuous memory
+template <typename A>
+static void PackRows(const A* src, int ld, int count, int k0, int depth, A* dst) {
+    for (int i = 0; i < count; i++) {
+        memcpy(dst + i * depth, src + i * ld + k0, depth * sizeof (A));
+    }
+}
+
+//same with conversion of elements to type of calculations
+template <typename T, typename A>
+static void PackRows(const T* src, int ld, int count, int k0, int depth, A* dst) {
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < depth; k++) {
+            dst[i * depth + k] = Element<T>::ToAcc(src[i * ld + k0 + k]);
+        }
+    }
+}
+
+//C += A * B, lda, ldb, ldc are row lengths of matrices in memory
+//blocks of C are divided between threads (if compiled with OpenMP)
+template <typename T>
+static void MultiplyAddBlock(const T* A, int lda, const T* B, int ldb, typename Element<T>::Acc* C, int ldc, int rows, int cols, int depth) {
+    typedef typename Element<T>::Acc Acc;
+    static TileFunc<Acc> tile = SelectTile<T>();
+
+    int blocksI = (rows + blockRows - 1) / blockRows;
+    int blocksJ = (cols + blockCols - 1) / blockCols;
+
+    for (int k0 = 0; k0 < depth; k0 += blockDepth) {
+        int kc = (depth - k0 < blockDepth) ? (depth - k0) : blockDepth;
+
+        #pragma omp parallel
+        {
+            //every thread packs blocks to its own memory
+            Acc* packA = new Acc[blockRows * blockDepth];
+            Acc* packB = new Acc[blockCols * blockDepth];
+            int packedJ = -1; //block of B which is already in packB
+
+            #pragma omp for collapse(2) schedule(static)
+            for (int bj = 0; bj < blocksJ; bj++) {
+                for (int bi = 0; bi < blocksI; bi++) {
+                    int j0 = bj * blockCols, i0 = bi * blockRows;
+                    int nc = (cols - j0 < blockCols) ? (cols - j0) : blockCols;
+                    int mc = (rows - i0 < blockRows) ? (rows - i0) : blockRows;
+
+                    if (packedJ != bj) {
+                        PackRows(B + j0 * ldb, ldb, nc, k0, kc, packB);
+                        packedJ = bj;
+                    }
+                    PackRows(A + i0 * lda, lda, mc, k0, kc, packA);
+
+                    //go through block with register tiles
+                    for (int i = 0; i < mc; i += tileRows) {
+                        for (int j = 0; j < nc; j += tileCols) {
+                            Acc* c = C + (i0 + i) * ldc + j0 + j;
+                            if (i + tileRows <= mc && j + tileCols <= nc) {
+                                tile(packA + i * kc, packB + j * kc, kc, c, ldc);
+                            } else {
+                                TileEdge(packA + i * kc, packB + j * kc, kc, c, ldc,
+                                        (mc - i < tileRows) ? (mc - i) : tileRows, (nc - j < tileCols) ? (nc - j) : tileCols);
+                            }
+                        }
+                    }
+                }
+            }
+
+            delete[] packA;
+            delete[] packB;
+        }
+    }
+}
+
+//allocates memory and fills it with zeros from all threads
+//so pages of memory are placed at NUMA node of threads which will use them
+template <typename T>
+static T* AllocateTouched(long count) {
+    T* buffer = new T[count];
+
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < count; i++) {
+        buffer[i] = T();
+    }
+    return buffer;
+}
+
+//C = A * B, lda, ldb, ldc are row lengths of matrices in memory
+template <typename T>
+static void MultiplyBlock(const T* A, int lda, const T* B, int ldb, typename Element<T>::Acc* C, int ldc, int rows, int cols, int depth) {
+    for (int i = 0; i < rows; i++) {
+        memset(C + i * ldc, 0, cols * sizeof (typename Element<T>::Acc));
+    }
+    MultiplyAddBlock(A, lda, B, ldb, C, ldc, rows, cols, depth);
+}
+
+#endif /* KERNEL_H */
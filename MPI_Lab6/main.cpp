@@ -1,160 +1,797 @@
 #include <mpich/mpi.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
 #include <iostream>
+#include <string>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "kernel.h"
+#include "summa.h"
+#include "sparse.h"
+#include "batch.h"
+#include "strassen.h"
+#include "../common/binfile.h"
+#include "../common/metrics.h"
+#include "../common/bench.h"
 
 enum Tags {
     tag0 = 0,
     tag1 = 1
 };
 
-//matrix B is transposed!
+//ways to shift columns of matrix B between processes
+//partners of shifts are same at every step, so persistent and neighbor modes set up transfers once
+enum ShiftModes {
+    shiftBlocking = 0, //compute, then wait for MPI_Sendrecv_replace
+    shiftOverlap = 1, //compute while next part of B is transferred to second buffer
+    shiftPersistent = 2, //as overlap, transfers are persistent requests (MPI_Send_init, MPI_Recv_init)
+    shiftNeighbor = 3 //as overlap, transfer is neighborhood collective of ring topology (MPI_Ineighbor_alltoall)
+};
 
-int main(int argc, char* argv[]) {
+const char* const shiftModeNames[] = {"blocking", "overlap", "persistent", "neighbor"};
 
-    int matrixRank = 600; //rank of square matrices to multiple
-    int maxNumsInMatrix = 100; //maximum values of elements of matrices
-    
-    clock_t tStart;
+//parallel methods of multiplication
+enum Methods {
+    methodRibbon = 0, //1D ribbons, rank of matrices must be divisible by processes count
+    methodSumma = 1, //2D grid of processes, any rank of matrices
+    methodSparse = 2, //A in CSR, rows of A and B divided between processes, any rank of matrices
+    methodSpmv = 3, //as sparse, but B is first column of matrix B (vector)
+    methodStrassen = 4 //Strassen-Winograd recursion, 7 products of levels are divided between groups of processes
+};
+
+//matrix B is transposed!
+
+//multiplication of matrices with ribbon method
+//matrixA, matrixB and matrixC are used only on process 0 of comm
+//if files are given, processes read and write their parts of matrices directly
+//parts of A and B are sent with elements of type T, so fp16 and bf16 halve bytes of scatter and shifts
+template <typename T>
+void MultiplyRibbon(T* matrixA, T* matrixB, typename Element<T>::Acc* matrixC, int matrixRank, int shiftMode, MPI_Comm comm, const MatrixFiles* files) {
+    typedef typename Element<T>::Acc Acc;
+    MPI_Datatype type = Element<T>::Type(), accType = Element<Acc>::Type();
     int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+
+    int linesInTask = matrixRank / mpi_size; //how much lines per task/process
+    int elemsPerTask = matrixRank*linesInTask; //how much elements of matrices per process
+
+    //buffers for storing parts of matrices
+    T* bufferA = AllocateTouched<T>(elemsPerTask);
+    T* bufferB = AllocateTouched<T>(elemsPerTask);
+    Acc* bufferC = AllocateTouched<Acc>(elemsPerTask);
+    T* bufferNextB = (shiftMode != shiftBlocking) ? AllocateTouched<T>(elemsPerTask) : NULL; //second buffer for received part of B
+
+    //send parts of matrices to all processes
+    if (files != NULL && files->readInput) {
+        metrics.Start(phaseIO);
+        ReadMatrixBlock(files->fileA, files->headerA, false, mpi_rank * linesInTask, 0, linesInTask, matrixRank, bufferA, matrixRank);
+        ReadMatrixBlock(files->fileB, files->headerB, true, mpi_rank * linesInTask, 0, linesInTask, matrixRank, bufferB, matrixRank);
+        metrics.Stop(phaseIO);
+        metrics.AddBytes(callFileRead, 2L * elemsPerTask * sizeof (T));
+    } else {
+        metrics.Start(phaseScatter);
+        MPI_Scatter(matrixA, elemsPerTask, type, bufferA, elemsPerTask, type, 0, comm);
+        MPI_Scatter(matrixB, elemsPerTask, type, bufferB, elemsPerTask, type, 0, comm);
+        metrics.Stop(phaseScatter);
+        metrics.AddBytes(callScatter, 2L * elemsPerTask * sizeof (T));
+    }
+
+    int shift;
+    int prevRank = (mpi_rank == 0) ? (mpi_size - 1) : (mpi_rank - 1);
+    int nextRank = (mpi_rank == (mpi_size - 1)) ? 0 : (mpi_rank + 1);
+    MPI_Request shiftRequests[2];
+
+    //persistent requests for both directions of swap of buffers:
+    //even steps send bufferB and receive to bufferNextB, odd steps use buffers after swap
+    MPI_Request persistentRequests[2][2];
+    if (shiftMode == shiftPersistent) {
+        T* buffers[2] = {bufferB, bufferNextB};
+        for (int set = 0; set < 2; set++) {
+            MPI_Recv_init(buffers[1 - set], elemsPerTask, type, nextRank, tag1, comm, &persistentRequests[set][0]);
+            MPI_Send_init(buffers[set], elemsPerTask, type, prevRank, tag1, comm, &persistentRequests[set][1]);
+        }
+    }
+
+    //ring topology: every process receives from next process and sends to previous one
+    MPI_Comm ringComm = MPI_COMM_NULL;
+    if (shiftMode == shiftNeighbor) {
+        MPI_Dist_graph_create_adjacent(comm, 1, &nextRank, MPI_UNWEIGHTED, 1, &prevRank, MPI_UNWEIGHTED,
+                MPI_INFO_NULL, 0, &ringComm);
+    }
+
+    //multiple matrices with ribbon method
+    //need to shift columns of matrix B between processes mpi_size times
+    for (int i = 0; i < mpi_size; i++) {
+
+        //start shift of columns of matrix B before calculations
+        if (i < (mpi_size - 1)) {
+            if (shiftMode == shiftOverlap) {
+                MPI_Irecv(bufferNextB, elemsPerTask, type, nextRank, tag1, comm, &shiftRequests[0]);
+                MPI_Isend(bufferB, elemsPerTask, type, prevRank, tag1, comm, &shiftRequests[1]);
+            } else if (shiftMode == shiftPersistent) {
+                shiftRequests[0] = persistentRequests[i % 2][0];
+                shiftRequests[1] = persistentRequests[i % 2][1];
+                MPI_Startall(2, shiftRequests);
+            } else if (shiftMode == shiftNeighbor) {
+                MPI_Ineighbor_alltoall(bufferB, elemsPerTask, type, bufferNextB, elemsPerTask, type, ringComm, &shiftRequests[0]);
+                shiftRequests[1] = MPI_REQUEST_NULL;
+            }
+        }
+
+        //calculate such elements of C for which process has rows of A and columns of B
+        shift = (i + mpi_rank) % mpi_size * linesInTask; //shift in matrix C
+        metrics.Start(phaseCompute);
+        MultiplyBlock(bufferA, matrixRank, bufferB, matrixRank, bufferC + shift, matrixRank, linesInTask, linesInTask, matrixRank);
+        metrics.Stop(phaseCompute);
+
+        //shift columns of matrix B to previous process
+        if (i < (mpi_size - 1)) {
+            metrics.Start(phaseShift);
+            long bytes = (long) elemsPerTask * sizeof (T);
+            if (shiftMode == shiftBlocking) {
+                metrics.AddBytes(callSendrecv, bytes);
+            } else if (shiftMode == shiftNeighbor) {
+                metrics.AddBytes(callAlltoall, bytes);
+            } else {
+                metrics.AddBytes(callSend, bytes);
+                metrics.AddBytes(callRecv, bytes);
+            }
+            if (shiftMode != shiftBlocking) {
+                //wait for transfer and swap buffers
+                MPI_Waitall(2, shiftRequests, MPI_STATUSES_IGNORE);
+                T* temp = bufferB;
+                bufferB = bufferNextB;
+                bufferNextB = temp;
+            } else {
+                MPI_Sendrecv_replace(bufferB, elemsPerTask, type, prevRank, tag1,
+                        nextRank, tag1, comm, MPI_STATUS_IGNORE);
+            }
+            metrics.Stop(phaseShift);
+        }
+
+    }
+
+    if (shiftMode == shiftPersistent) {
+        for (int set = 0; set < 2; set++) {
+            MPI_Request_free(&persistentRequests[set][0]);
+            MPI_Request_free(&persistentRequests[set][1]);
+        }
+    }
+    if (ringComm != MPI_COMM_NULL) MPI_Comm_free(&ringComm);
 
-    MPI_Init(&argc, &argv);
+    MPI_Barrier(comm);
+
+    //gather matrix C
+    if (files != NULL && files->writeOutput) {
+        metrics.Start(phaseIO);
+        WriteMatrixBlock(files->fileC, files->headerC, mpi_rank * linesInTask, 0, linesInTask, matrixRank, bufferC, matrixRank);
+        metrics.Stop(phaseIO);
+        metrics.AddBytes(callFileWrite, (long) elemsPerTask * sizeof (Acc));
+    } else {
+        metrics.Start(phaseGather);
+        MPI_Gather(bufferC, elemsPerTask, accType, matrixC, elemsPerTask, accType, 0, comm);
+        metrics.Stop(phaseGather);
+        metrics.AddBytes(callGather, (long) elemsPerTask * sizeof (Acc));
+    }
+
+    delete[] bufferA;
+    delete[] bufferB;
+    delete[] bufferC;
+    if (bufferNextB != NULL) delete[] bufferNextB;
+}
+
+//reads full matrix from file by one process
+template <typename T>
+bool LoadMatrix(const char* path, bool transposed, T* matrix, int matrixRank) {
+    MPI_File file;
+    FileHeader header;
+    if (!OpenDataFile(path, MPI_COMM_SELF, file, header, Element<T>::dtype)) return false;
+    ReadMatrixBlock(file, header, transposed, 0, 0, matrixRank, matrixRank, matrix, matrixRank);
+    MPI_File_close(&file);
+    return true;
+}
+
+//position of next nonzero after position, gaps between nonzeros are geometric with probability density
+//(logSkip is log(1 - density), 0 if all elements are nonzero), result is at most size
+static long NextNonzero(long position, double logSkip, long size, unsigned& seed) {
+    if (logSkip == 0) return position + 1;
+    double gap = log((rand_r(&seed) + 1.0) / ((double) RAND_MAX + 2.0)) / logSkip;
+    return (gap < size - position) ? position + 1 + (long) gap : size;
+}
+
+//random CSR matrix, every element is nonzero with probability density
+//only nonzeros are generated, so time doesn't depend on rows * cols:
+//positions are made twice from same seed, first to count nonzeros, then to fill matrix
+template <typename T>
+static void GenerateSparse(int rows, int cols, double density, int maxNumsInMatrix, SparseMatrix<T>& matrix) {
+    long size = (long) rows * cols;
+    double logSkip = (density < 1) ? log(1 - density) : 0;
+    unsigned start = rand();
+    for (int pass = 0; pass < 2; pass++) {
+        unsigned seed = start;
+        long position = NextNonzero(-1, logSkip, size, seed);
+        int n = 0;
+        for (int i = 0; i < rows; i++) {
+            long end = (long) (i + 1) * cols;
+            for (; position < end; position = NextNonzero(position, logSkip, size, seed), n++) {
+                if (pass == 0) continue;
+                matrix.indices[n] = position - (long) i * cols;
+                matrix.values[n] = RandomElement<T>(rand(), maxNumsInMatrix);
+            }
+            if (pass == 1) matrix.starts[i + 1] = n;
+        }
+        if (pass == 0) InitSparse(matrix, rows, cols, n);
+    }
+}
+
+//options of command line
+struct Options {
+    int matrixRank; //rank of square matrices to multiple
+    int maxNumsInMatrix; //maximum values of elements of matrices
+    int method; //parallel method of multiplication
+    int shiftMode; //how to shift columns of matrix B (ribbon method)
+    double density; //part of nonzero elements of matrix A
+    int levels; //levels of recursion of Strassen method
+    int warmup, repeats;
+    bool check; //compare result with linear method
+    const char *fileNameA, *fileNameB, *fileNameC; //files of matrices or NULL
+    const char* jobList; //list of jobs of batch mode or NULL
+};
+
+//batch mode: many independent multiplications in one launch
+//returns false if list of jobs is not correct
+template <typename T>
+static bool RunBatch(const Options& options) {
+    typedef typename Element<T>::Acc Acc;
+    int mpi_rank, mpi_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
 
+    BatchJob* jobs = NULL;
+    int count = ParseBatchJobs(options.jobList, jobs);
+    if (count <= 0) {
+        if (mpi_rank == 0) std::cout << "\nList of jobs is not correct, example: -b 8x64,2x600\n";
+        return false;
+    }
 
-    srand(1); //for generation same values every time
+    //work of batch: 2 * rank^3 operations, input and output matrices of all jobs
+    double flops = 0, bytes = 0;
+    int large = 0;
+    for (int j = 0; j < count; j++) {
+        double rank = jobs[j].rank;
+        flops += 2.0 * rank * rank * rank;
+        bytes += rank * rank * (2.0 * sizeof (T) + sizeof (Acc));
+        if (jobs[j].rank >= batchSpreadRank) large++;
+    }
 
-    int linesInTask = matrixRank / mpi_size; //how much lines per task/process
+    //results of all jobs are kept on process 0 only for check
+    Acc** results = NULL;
+    if (mpi_rank == 0) {
+        std::cout << "\n=================";
+        std::cout << "\nJobs count = " << count << " (" << large << " with rank from " << batchSpreadRank << " are divided between processes)";
+        std::cout << "\nProcesses count = " << mpi_size;
+        std::cout << "\nType of elements = " << dataTypeNames[Element<T>::dtype];
+#ifdef _OPENMP
+        std::cout << "\nThreads per process = " << omp_get_max_threads();
+#endif
+        std::cout << "\nRepetitions = " << options.repeats << " (warmup " << options.warmup << ")";
+        std::cout << "\n=================";
+        std::cout << "\nParallel batch (time includes generation):";
 
-    long sizeFull = matrixRank * matrixRank; //full length of matrix
-    int *matrixA, *matrixB, *matrixC;
+        if (options.check) {
+            results = new Acc*[count];
+            for (int j = 0; j < count; j++) {
+                results[j] = new Acc[(long) jobs[j].rank * jobs[j].rank];
+            }
+        }
+    }
 
-    //check for correct input
-    if (sizeFull != matrixRank * linesInTask * mpi_size) {
-        if (mpi_rank == 0) std::cout << "\nArray can't be divided between processes";
-        return 0;
+    Benchmark bench;
+    InitBenchmark(bench, options.warmup, options.repeats);
+    for (int r = 0; r < RepetitionsCount(bench); r++) {
+        double tStart = StartRepetition(MPI_COMM_WORLD);
+        MultiplyBatch<T>(jobs, count, options.maxNumsInMatrix, results, MPI_COMM_WORLD);
+        StopRepetition(bench, tStart, MPI_COMM_WORLD);
     }
 
-    //main process
     if (mpi_rank == 0) {
+        double mean = ComputeStats(bench).mean;
+        printf("\nTime taken: %.4fs", mean);
+        printf("\nJobs per second: %.2f", count / mean);
+
+        //every job is generated again and multiplied with linear method
+        int checked = -1;
+        if (options.check) {
+            double tStart = MPI_Wtime();
+            metrics.Start(phaseLinear);
+            checked = 1;
+            for (int j = 0; j < count; j++) {
+                long size = (long) jobs[j].rank * jobs[j].rank;
+                T* matrixA = new T[size];
+                T* matrixB = new T[size];
+                Acc* matrixTest = new Acc[size];
+                GenerateJob(jobs[j], options.maxNumsInMatrix, matrixA, matrixB);
+                MultiplyBlock(matrixA, jobs[j].rank, matrixB, jobs[j].rank, matrixTest, jobs[j].rank, jobs[j].rank, jobs[j].rank, jobs[j].rank);
+                if (!EqualElements<T>(results[j], matrixTest, size)) checked = 0;
+                delete[] matrixA;
+                delete[] matrixB;
+                delete[] matrixTest;
+                delete[] results[j];
+            }
+            delete[] results;
+            metrics.Stop(phaseLinear);
 
+            std::cout << "\n=================";
+            std::cout << "\nLinear:";
+            printf("\nTime taken: %.4fs", MPI_Wtime() - tStart);
+            std::cout << "\nResult is " << (checked ? "equal" : "NOT equal") << " to linear method";
+        }
+
+        std::string variant = "batch";
+        if (Element<T>::dtype != dtypeInt32) variant = variant + "-" + dataTypeNames[Element<T>::dtype];
         std::cout << "\n=================";
-        std::cout << "\nMatrix rank = " << matrixRank;
-        std::cout << "\nProcesses count = " << mpi_size;
-        std::cout << "\nMatrix lines per process = " << linesInTask;
+        PrintBenchmark(bench, "lab6", variant.c_str(), count, mpi_size, flops, bytes, checked);
+        std::cout << "\n=================\n";
+    }
+    FreeBenchmark(bench);
+    delete[] jobs;
 
-        matrixA = new int[sizeFull];
-        matrixB = new int[sizeFull];
-        matrixC = new int[sizeFull];
+    return true;
+}
 
-        //generation of matrices A and B
-        for (long i = 0; i < sizeFull; i++) {
-            matrixA[i] = rand() % maxNumsInMatrix;
-            matrixB[i] = rand() % maxNumsInMatrix;
+//multiplication with elements of type T, C has elements of type Element<T>::Acc
+//returns false if input is not correct
+template <typename T>
+static bool Multiply(const Options& options) {
+    if (options.jobList != NULL) return RunBatch<T>(options);
+
+    typedef typename Element<T>::Acc Acc;
+    int matrixRank = options.matrixRank;
+    int maxNumsInMatrix = options.maxNumsInMatrix;
+    int method = options.method;
+    int shiftMode = options.shiftMode;
+    double density = options.density;
+    bool check = options.check;
+    bool sparse = method == methodSparse || method == methodSpmv;
+
+    double tStart;
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
+
+    //files of matrices
+    //if files of A and B don't exist, they are created from generated matrices
+    MatrixFiles files;
+    const char *fileNameA = options.fileNameA, *fileNameB = options.fileNameB, *fileNameC = options.fileNameC;
+    files.readInput = fileNameA != NULL;
+    files.writeOutput = fileNameC != NULL;
+
+    //arguments are checked before files are opened
+    if (files.writeOutput && method == methodSpmv) {
+        if (mpi_rank == 0) std::cout << "\nResult of spmv method is vector, it isn't written to file\n";
+        return false;
+    }
+    if (files.writeOutput && method == methodStrassen) {
+        if (mpi_rank == 0) std::cout << "\nResult of strassen method is only on process 0, it isn't written to file\n";
+        return false;
+    }
+
+    if (files.readInput) {
+        int written = 1;
+        if (mpi_rank == 0 && !(FileExists(fileNameA) && FileExists(fileNameB))) {
+            long size = (long) matrixRank * matrixRank;
+            T* generatedA = new T[size];
+            T* generatedB = new T[size];
+            for (long i = 0; i < size; i++) {
+                generatedA[i] = RandomElement<T>(rand(), maxNumsInMatrix);
+                generatedB[i] = RandomElement<T>(rand(), maxNumsInMatrix);
+                if (density < 1 && rand() >= density * RAND_MAX) generatedA[i] = T();
+            }
+            written = WriteDataFile(fileNameA, 2, matrixRank, matrixRank, 0, generatedA)
+                    && WriteDataFile(fileNameB, 2, matrixRank, matrixRank, flagTransposed, generatedB);
+            delete[] generatedA;
+            delete[] generatedB;
         }
 
-        std::cout << "\nMatrix A first elements: ";
-        for (int i = 0; i < 10; i++) {
-            std::cout << matrixA[i] << " ";
+        //other processes wait for files and don't open them if they weren't written
+        MPI_Bcast(&written, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!written) {
+            if (mpi_rank == 0) std::cout << "\nFiles of matrices can't be written\n";
+            return false;
+        }
+
+        bool openedA = OpenDataFile(fileNameA, MPI_COMM_WORLD, files.fileA, files.headerA, Element<T>::dtype);
+        bool openedB = openedA && OpenDataFile(fileNameB, MPI_COMM_WORLD, files.fileB, files.headerB, Element<T>::dtype);
+        if (!openedB || files.headerA.dims != 2 || files.headerA.shape[0] != files.headerA.shape[1]
+                || files.headerB.shape[0] != files.headerA.shape[0] || files.headerB.shape[1] != files.headerA.shape[1]) {
+            if (mpi_rank == 0) std::cout << "\nFiles of matrices can't be read, have other type of elements or matrices are not square of same rank\n";
+            if (openedA) MPI_File_close(&files.fileA);
+            if (openedB) MPI_File_close(&files.fileB);
+            return false;
+        }
+        matrixRank = files.headerA.shape[0];
+    }
+    //check for correct input, rank of matrices from files is known here
+    if (method == methodRibbon && matrixRank % mpi_size != 0) {
+        if (mpi_rank == 0) std::cout << "\nArray can't be divided between processes\n";
+        if (files.readInput) {
+            MPI_File_close(&files.fileA);
+            MPI_File_close(&files.fileB);
         }
-        std::cout << "\nMatrix B first elements: ";
-        for (int i = 0; i < 10; i++) {
-            std::cout << matrixB[i] << " ";
+        return false;
+    }
+    if (files.writeOutput && !CreateMatrixFile(fileNameC, matrixRank, matrixRank, Element<Acc>::dtype, MPI_COMM_WORLD, files.fileC, files.headerC)) {
+        if (mpi_rank == 0) std::cout << "\nFile of matrix C can't be created\n";
+        if (files.readInput) {
+            MPI_File_close(&files.fileA);
+            MPI_File_close(&files.fileB);
         }
+        return false;
+    }
+
+    long sizeFull = (long) matrixRank * matrixRank; //full length of matrix
+    T *matrixA = NULL, *matrixB = NULL;
+    Acc* matrixC = NULL;
+    Acc* matrixTest = NULL; //result of linear method
+
+    //with files ribbon and SUMMA methods read and write their blocks directly, so full matrices
+    //are on process 0 only for check, for methods which distribute them from process 0 and for result without file
+    //sparse methods generate A in CSR and only columns of B which they use, full matrices are made only for check,
+    //but A from file is read full to be compressed
+    bool fullInput = check || method == methodStrassen || (files.readInput ? sparse : !sparse);
+    bool fullOutput = !files.writeOutput || check;
+
+    //sparse methods: matrix A in CSR and B (width columns) on process 0
+    SparseMatrix<T> sparseA;
+    int width = (method == methodSpmv) ? 1 : matrixRank; //columns of B and C
+    T* rowsB = NULL; //matrix B is transposed, so its rows are columns
+
+    //main process
+    if (mpi_rank == 0) {
 
         std::cout << "\n=================";
-        std::cout << "\nLinear:";
+        std::cout << "\nMatrix rank = " << matrixRank;
+        std::cout << "\nProcesses count = " << mpi_size;
+        std::cout << "\nType of elements = " << dataTypeNames[Element<T>::dtype];
+#ifdef _OPENMP
+        std::cout << "\nThreads per process = " << omp_get_max_threads();
+#endif
+        if (method == methodRibbon) {
+            std::cout << "\nMatrix lines per process = " << matrixRank / mpi_size;
+            std::cout << "\nShift mode = " << shiftModeNames[shiftMode];
+        }
+        if (method == methodStrassen) {
+            std::cout << "\nLevels of recursion = " << options.levels << " (classic method from rank " << strassenCutoff << ")";
+        }
+        if (density < 1) std::cout << "\nDensity of matrix A = " << density;
 
-        //calculations time
-        tStart = clock();
+        std::cout << "\nRepetitions = " << options.repeats << " (warmup " << options.warmup << ")";
 
-        //multiplies matrices with linear method
-        for (int i = 0; i < matrixRank; i++) {
-            for (int j = 0; j < matrixRank; j++) {
-                
-                matrixC[i * matrixRank + j] = 0;
-                
+        if (fullOutput) matrixC = new Acc[sparse ? (long) matrixRank * width : sizeFull];
+
+        if (sparse && !files.readInput) {
+            metrics.Start(phaseGenerate);
+            GenerateSparse(matrixRank, matrixRank, density, maxNumsInMatrix, sparseA);
+            rowsB = new T[(long) matrixRank * width];
+            for (int j = 0; j < width; j++) {
                 for (int k = 0; k < matrixRank; k++) {
-                    matrixC[i * matrixRank + j] += matrixA[i * matrixRank + k] * matrixB[j * matrixRank + k];
+                    rowsB[(long) k * width + j] = RandomElement<T>(rand(), maxNumsInMatrix);
                 }
             }
+            metrics.Stop(phaseGenerate);
         }
 
-        printf("\nTime taken: %.4fs", (double) (clock() - tStart) / CLOCKS_PER_SEC);
+        //generation of matrices A and B (or reading them for linear method)
+        if (fullInput) {
+            matrixA = new T[sizeFull];
+            matrixB = new T[sizeFull];
+            metrics.Start(phaseGenerate);
+            if (files.readInput) {
+                LoadMatrix(fileNameA, false, matrixA, matrixRank);
+                LoadMatrix(fileNameB, true, matrixB, matrixRank);
+            } else if (sparse) {
+                //same matrices as generated for sparse methods, columns of B after width are not used
+                ExpandRows(sparseA, matrixA, matrixRank);
+                for (int j = 0; j < matrixRank; j++) {
+                    for (int k = 0; k < matrixRank; k++) {
+                        matrixB[(long) j * matrixRank + k] = (j < width) ? rowsB[(long) k * width + j] : RandomElement<T>(rand(), maxNumsInMatrix);
+                    }
+                }
+            } else {
+                for (long i = 0; i < sizeFull; i++) {
+                    matrixA[i] = RandomElement<T>(rand(), maxNumsInMatrix);
+                    matrixB[i] = RandomElement<T>(rand(), maxNumsInMatrix);
+                    if (density < 1 && rand() >= density * RAND_MAX) matrixA[i] = T();
+                }
+            }
+            metrics.Stop(phaseGenerate);
 
-        std::cout << "\nMatrix C first elements: ";
-        for (int i = 0; i < 10; i++) {
-            std::cout << matrixC[i] << " ";
+            std::cout << "\nMatrix A first elements: ";
+            for (int i = 0; i < 10; i++) {
+                std::cout << Element<T>::ToAcc(matrixA[i]) << " ";
+            }
+            std::cout << "\nMatrix B first elements: ";
+            for (int i = 0; i < 10; i++) {
+                std::cout << Element<T>::ToAcc(matrixB[i]) << " ";
+            }
         }
 
-        std::cout << "\n=================";
-        std::cout << "\nParallel ribbon method:";
-        tStart = clock();
+        if (check) {
+            std::cout << "\n=================";
+            std::cout << "\nLinear:";
 
+            //calculations time
+            tStart = MPI_Wtime();
+            metrics.Start(phaseLinear);
 
-    }
+            //multiplies matrices with linear method
+            matrixTest = new Acc[sizeFull];
+            MultiplyBlock(matrixA, matrixRank, matrixB, matrixRank, matrixTest, matrixRank, matrixRank, matrixRank, matrixRank);
 
-    MPI_Barrier(MPI_COMM_WORLD);
+            metrics.Stop(phaseLinear);
+            printf("\nTime taken: %.4fs", MPI_Wtime() - tStart);
 
-    int elemsPerTask = matrixRank*linesInTask; //how much elements of matrices per process
+            std::cout << "\nMatrix C first elements: ";
+            for (int i = 0; i < 10; i++) {
+                std::cout << matrixTest[i] << " ";
+            }
+        }
 
-    //buffers for storing parts of matrices
-    int* bufferA = new int[elemsPerTask];
-    int* bufferB = new int[elemsPerTask];
-    int* bufferC = new int[elemsPerTask];
+        std::cout << "\n=================";
+        const char* names[] = {"\nParallel ribbon method:", "\nParallel SUMMA method:", "\nParallel sparse method (SpMM):", "\nParallel sparse method (SpMV):", "\nParallel Strassen-Winograd method:"};
+        std::cout << names[method];
+    }
 
-    //send parts of matrices to all processes
-    MPI_Scatter(matrixA, elemsPerTask, MPI_INT, bufferA, elemsPerTask, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Scatter(matrixB, elemsPerTask, MPI_INT, bufferB, elemsPerTask, MPI_INT, 0, MPI_COMM_WORLD);
+    //sparse methods: matrix A is compressed and distributed, communication plan is built once,
+    //only multiplications with exchange of needed rows of B are repeated
+    SparseMatrix<T> blockA;
+    SparsePlan<T> plan;
+    T* blockB = NULL;
+    Acc* blockC = NULL;
+    long sparseNonzeros = 0;
+    if (sparse) {
+        int rows = SparseRowCount(matrixRank, mpi_size, mpi_rank);
+        if (mpi_rank == 0 && files.readInput) {
+            CompressRows(matrixA, matrixRank, matrixRank, matrixRank, sparseA);
+            rowsB = new T[(long) matrixRank * width];
+            for (int k = 0; k < matrixRank; k++) {
+                for (int j = 0; j < width; j++) {
+                    rowsB[(long) k * width + j] = matrixB[(long) j * matrixRank + k];
+                }
+            }
+        }
 
-    int shift, col, row, el;
+        tStart = MPI_Wtime();
+        blockB = AllocateTouched<T>((long) rows * width + 1);
+        blockC = AllocateTouched<Acc>((long) rows * width + 1);
+        ScatterSparseRows((mpi_rank == 0) ? &sparseA : NULL, matrixRank, matrixRank, MPI_COMM_WORLD, blockA);
+        ExchangeDenseRows(rowsB, matrixRank, width, blockB, false, MPI_COMM_WORLD);
+        BuildSparsePlan(blockA, matrixRank, width, MPI_COMM_WORLD, plan);
+
+        //how many rows of B are received by all processes
+        long nonzeros = SparseNonzeros(blockA), received = plan.remotePart.cols;
+        long totals[2], locals[2] = {nonzeros, received};
+        MPI_Reduce(locals, totals, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (mpi_rank == 0) {
+            sparseNonzeros = totals[0];
+            printf("\nNonzeros of A: %ld (%.4f%%)", totals[0], 100.0 * totals[0] / sizeFull);
+            printf("\nRows of B received by processes: %ld", totals[1]);
+            printf("\nDistribution and plan time: %.4fs", MPI_Wtime() - tStart);
+            FreeSparse(sparseA);
+            delete[] rowsB;
+        }
+    }
 
-    //multiple matrices with ribbon method
-    //need to shift columns of matrix B between processes mpi_size times
-    for (int i = 0; i < mpi_size; i++) {
+    //repeat parallel multiplication, time of each repetition is time of slowest process
+    Benchmark bench;
+    InitBenchmark(bench, options.warmup, options.repeats);
+    for (int r = 0; r < RepetitionsCount(bench); r++) {
+        tStart = StartRepetition(MPI_COMM_WORLD);
+
+        if (method == methodRibbon) {
+            MultiplyRibbon(matrixA, matrixB, matrixC, matrixRank, shiftMode, MPI_COMM_WORLD, &files);
+        } else if (sparse) {
+            MultiplySparse(plan, blockB, blockC, MPI_COMM_WORLD);
+        } else if (method == methodStrassen) {
+            MultiplyStrassen(matrixA, matrixB, matrixC, matrixRank, options.levels, MPI_COMM_WORLD);
+        } else {
+            MultiplySumma(matrixA, matrixB, matrixC, matrixRank, MPI_COMM_WORLD, &files);
+        }
 
-        //calculate such elements of C for which process has rows of A and columns of B
-        for (col = 0; col < linesInTask; col++) {
-            for (row = 0; row < linesInTask; row++) {
+        StopRepetition(bench, tStart, MPI_COMM_WORLD);
+    }
+
+    //blocks of C of sparse methods
+    if (sparse) {
+        if (files.writeOutput) {
+            metrics.Start(phaseIO);
+            WriteMatrixBlock(files.fileC, files.headerC, SparseRowStart(matrixRank, mpi_size, mpi_rank), 0, blockA.rows, matrixRank, blockC, matrixRank);
+            metrics.Stop(phaseIO);
+            metrics.AddBytes(callFileWrite, (long) blockA.rows * width * sizeof (Acc));
+        } else {
+            ExchangeDenseRows(matrixC, matrixRank, width, blockC, true, MPI_COMM_WORLD);
+        }
+        FreeSparsePlan(plan);
+        FreeSparse(blockA);
+        delete[] blockB;
+        delete[] blockC;
+    }
 
-                shift = (i + mpi_rank) % mpi_size * linesInTask; //shift in matrix C
-                bufferC[row * matrixRank + col + shift] = 0;
+    if (files.readInput) {
+        MPI_File_close(&files.fileA);
+        MPI_File_close(&files.fileB);
+    }
+    if (files.writeOutput) MPI_File_close(&files.fileC);
 
-                //calculate one element
-                for (el = 0; el < matrixRank; el++) {
-                    bufferC[row * matrixRank + col + shift] += bufferA[row * matrixRank + el] * bufferB[col * matrixRank + el];
-                }
+    if (mpi_rank == 0) {
+        printf("\nTime taken: %.4fs", ComputeStats(bench).mean);
+        if (files.writeOutput) {
+            std::cout << "\nMatrix C is written to " << fileNameC;
+            if (check) LoadMatrix(fileNameC, false, matrixC, matrixRank);
+        } else {
+            std::cout << "\nMatrix C first elements: ";
+            for (int i = 0; i < 10; i++) {
+                std::cout << matrixC[i] << " ";
             }
         }
 
-        //shift columns of matrix B to previous process
-        if (i < (mpi_size - 1)) {
-            MPI_Sendrecv(bufferB, elemsPerTask, MPI_INT, (mpi_rank == 0) ? (mpi_size - 1) : (mpi_rank - 1), tag1,
-                    bufferB, elemsPerTask, MPI_INT, (mpi_rank == (mpi_size - 1)) ? 0 : (mpi_rank + 1), tag1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        //compare with result of linear method
+        int checked = -1;
+        double maxError = -1;
+        if (check) {
+            if (method == methodSpmv) {
+                //vector is first column of result of linear method
+                checked = 1;
+                for (int i = 0; i < matrixRank; i++) {
+                    if (!EqualElements<T>(matrixC + i, matrixTest + (long) i * matrixRank, 1)) checked = 0;
+                }
+            } else if (method == methodStrassen && !std::numeric_limits<Acc>::is_integer) {
+                //rounding errors of Strassen method are bounded only relative to max element
+                maxError = MaxRelativeError(matrixC, matrixTest, sizeFull);
+                checked = maxError <= StrassenTolerance(Element<T>::Tolerance(), options.levels);
+            } else {
+                checked = EqualElements<T>(matrixC, matrixTest, sizeFull);
+            }
+            std::cout << "\nResult is " << (checked ? "equal" : "NOT equal") << " to linear method";
+            if (maxError >= 0) printf("\nMax error relative to classic method: %.3e", maxError);
         }
 
+        //work of one multiplication: 2 * rank^3 operations, input and output matrices
+        //(Strassen method makes less operations, its rate is rate of classic method with same time)
+        //sparse methods: 2 operations per nonzero of A and column of B, nonzeros of A, B and C
+        const char* variants[] = {"ribbon", "summa", "sparse-spmm", "sparse-spmv", "strassen"};
+        std::string variant = variants[method];
+        if (method == methodRibbon) variant = variant + "-" + shiftModeNames[shiftMode];
+        if (method == methodStrassen) variant = variant + "-l" + std::to_string(options.levels);
+        if (Element<T>::dtype != dtypeInt32) variant = variant + "-" + dataTypeNames[Element<T>::dtype];
+        double flops = 2.0 * matrixRank * matrixRank * matrixRank;
+        double bytes = sizeFull * (2.0 * sizeof (T) + sizeof (Acc));
+        if (sparse) {
+            flops = 2.0 * sparseNonzeros * width;
+            bytes = sparseNonzeros * (double) (sizeof (int) + sizeof (T)) + (double) matrixRank * width * (sizeof (T) + sizeof (Acc));
+        }
+        PrintBenchmark(bench, "lab6", variant.c_str(), matrixRank, mpi_size, flops, bytes, checked);
+        std::cout << "\n=================\n";
     }
-
-    MPI_Barrier(MPI_COMM_WORLD);
-    
-    //gather matrix C
-    MPI_Gather(bufferC, elemsPerTask, MPI_INT, matrixC, elemsPerTask, MPI_INT, 0, MPI_COMM_WORLD);
+    FreeBenchmark(bench);
 
 
     if (mpi_rank == 0) {
-        printf("\nTime taken: %.4fs", (double) (clock() - tStart) / CLOCKS_PER_SEC);
-        std::cout << "\nMatrix C first elements: ";
-        for (int i = 0; i < 10; i++) {
-            std::cout << matrixC[i] << " ";
-        }
-        std::cout << "\n=================\n";
+        delete[] matrixA;
+        delete[] matrixB;
+        delete[] matrixC;
+        if (matrixTest != NULL) delete[] matrixTest;
     }
 
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+
+    Options options;
+    options.matrixRank = 600;
+    options.maxNumsInMatrix = 100;
+    options.method = methodSumma;
+    options.shiftMode = shiftOverlap;
+    options.density = 1;
+    options.levels = 1;
+    options.warmup = 0;
+    options.repeats = 1;
+    options.check = true;
+    options.jobList = NULL;
+    int dtype = dtypeInt32; //type of elements of matrices
+
+    int mpi_rank;
+
+    //only main thread of process calls MPI, other threads are used in calculations
+    int threadSupport;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
+    MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+    CheckThreadSupport(threadSupport, mpi_rank);
+
+
+    srand(1); //for generation same values every time
 
-    delete bufferA, bufferB, bufferC;
-    if (mpi_rank == 0) delete matrixA, matrixB, matrixC;
+    //options: mpi_lab6 [-n rank] [-m ribbon|summa|sparse|spmv|strassen] [-l levels] [-s overlap|blocking|persistent|neighbor] [-d density] [-t int32|int64|float|double|fp16|bf16] [-b jobs] [-w warmup] [-r repeats] [-x] [fileA fileB [fileC]]
+    //-x skips linear method and check of result
+    //-d makes matrix A sparse for all methods, so dense methods can be compared with sparse ones
+    //-t is type of elements of A and B, fp16 and bf16 are calculated in float, C is float for them
+    //-l is levels of recursion of Strassen method, each level divides 7 products between groups of processes
+    //-b multiplies batch of generated matrices instead of one pair, jobs are list of "count x rank", for example 8x64,2x600
+    int option;
+    opterr = mpi_rank == 0; //errors of options are printed once
+    while ((option = getopt(argc, argv, "n:m:s:l:d:t:b:w:r:x")) != -1) {
+        switch (option) {
+            case 'n': options.matrixRank = atoi(optarg);
+                break;
+            case 'm':
+                if (strcmp(optarg, "ribbon") == 0) options.method = methodRibbon;
+                else if (strcmp(optarg, "sparse") == 0) options.method = methodSparse;
+                else if (strcmp(optarg, "spmv") == 0) options.method = methodSpmv;
+                else if (strcmp(optarg, "strassen") == 0) options.method = methodStrassen;
+                else options.method = methodSumma;
+                break;
+            case 's':
+                options.shiftMode = shiftOverlap;
+                for (int mode = shiftBlocking; mode <= shiftNeighbor; mode++) {
+                    if (strcmp(optarg, shiftModeNames[mode]) == 0) options.shiftMode = mode;
+                }
+                break;
+            case 'w': options.warmup = atoi(optarg);
+                break;
+            case 'r': options.repeats = atoi(optarg);
+                break;
+            case 'd': options.density = atof(optarg);
+                break;
+            case 'l': options.levels = atoi(optarg);
+                break;
+            case 't': dtype = ParseDataType(optarg);
+                break;
+            case 'b': options.jobList = optarg;
+                break;
+            case 'x': options.check = false;
+                break;
+            default: dtype = -1;
+        }
+    }
+    if (dtype < 0) {
+        if (mpi_rank == 0) std::cout << "\nUsage: mpi_lab6 [-n rank] [-m ribbon|summa|sparse|spmv|strassen] [-l levels] [-s overlap|blocking|persistent|neighbor] [-d density] [-t int32|int64|float|double|fp16|bf16] [-b jobs] [-w warmup] [-r repeats] [-x] [fileA fileB [fileC]]\n";
+        MPI_Finalize();
+        return 0;
+    }
+    if (options.matrixRank <= 0) options.matrixRank = 1;
+    if (options.density > 1) options.density = 1;
+    if (options.levels < 0) options.levels = 0;
+
+    //files of matrices
+    options.fileNameA = options.fileNameB = options.fileNameC = NULL;
+    if (argc - optind >= 2) {
+        options.fileNameA = argv[optind];
+        options.fileNameB = argv[optind + 1];
+    }
+    if (argc - optind >= 3) options.fileNameC = argv[optind + 2];
+
+    bool done;
+    switch (dtype) {
+        case dtypeInt64: done = Multiply<long>(options);
+            break;
+        case dtypeFloat32: done = Multiply<float>(options);
+            break;
+        case dtypeFloat64: done = Multiply<double>(options);
+            break;
+        case dtypeFloat16: done = Multiply<float16>(options);
+            break;
+        case dtypeBfloat16: done = Multiply<bfloat16>(options);
+            break;
+        default: done = Multiply<int>(options);
+    }
 
+    if (done) metrics.Report("lab6", MPI_COMM_WORLD);
     MPI_Finalize();
 
     return 0;
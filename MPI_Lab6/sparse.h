@@ -0,0 +1,427 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <mpich/mpi.h>
+#include <string.h>
+#include "../common/element.h"
+#include "../common/metrics.h"
+
+//multiplication of sparse matrix A by dense matrix B (SpMM) or by vector (SpMV, B has one column)
+//A is stored in compressed sparse rows (CSR), rows of A and B are divided between processes
+//in balanced layout (first rows % mpi_size processes have one row more), so any rank of matrices
+//row i of C needs rows k of B for all nonzeros (i, k) of A, so process receives only rows of B
+//for nonzero columns of its block of A which belong to other processes
+//communication plan (which rows go to which process) is built once before multiplications:
+//needed columns are found from compressed sparse columns (CSC) of block of A,
+//lists of needed rows are exchanged with MPI_Alltoall and MPI_Alltoallv
+//in every multiplication only processes with needed rows exchange them without blocking,
+//nonzeros with local columns are multiplied while rows of other processes are transferred
+//A and B have elements of type T, C has elements of type Element<T>::Acc
+
+const int sparseTag = 2;
+
+//CSR: nonzeros of row i have indices [starts[i], starts[i + 1]), indices are columns
+//same arrays for transposed matrix are CSC of matrix (indices are rows)
+template <typename T>
+struct SparseMatrix {
+    int rows, cols;
+    int* starts;
+    int* indices;
+    T* values;
+};
+
+template <typename T>
+static void InitSparse(SparseMatrix<T>& matrix, int rows, int cols, int nonzeros) {
+    matrix.rows = rows;
+    matrix.cols = cols;
+    matrix.starts = new int[rows + 1];
+    matrix.indices = new int[nonzeros + 1];
+    matrix.values = new T[nonzeros + 1];
+    matrix.starts[0] = 0;
+}
+
+template <typename T>
+static void FreeSparse(SparseMatrix<T>& matrix) {
+    delete[] matrix.starts;
+    delete[] matrix.indices;
+    delete[] matrix.values;
+    matrix.starts = matrix.indices = NULL;
+    matrix.values = NULL;
+}
+
+template <typename T>
+static int SparseNonzeros(const SparseMatrix<T>& matrix) {
+    return matrix.starts[matrix.rows];
+}
+
+//CSR of dense matrix, ld is row length of matrix in memory
+template <typename T>
+static void CompressRows(const T* dense, int rows, int cols, int ld, SparseMatrix<T>& matrix) {
+    int nonzeros = 0;
+    for (long i = 0; i < (long) rows * ld; i++) {
+        if ((i % ld) < cols && Element<T>::ToAcc(dense[i]) != 0) nonzeros++;
+    }
+
+    InitSparse(matrix, rows, cols, nonzeros);
+    int n = 0;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            T value = dense[(long) i * ld + j];
+            if (Element<T>::ToAcc(value) == 0) continue;
+            matrix.indices[n] = j;
+            matrix.values[n] = value;
+            n++;
+        }
+        matrix.starts[i + 1] = n;
+    }
+}
+
+//dense matrix of CSR, ld is row length of matrix in memory
+template <typename T>
+static void ExpandRows(const SparseMatrix<T>& matrix, T* dense, int ld) {
+    for (int i = 0; i < matrix.rows; i++) {
+        T* row = dense + (long) i * ld;
+        for (int j = 0; j < matrix.cols; j++) {
+            row[j] = T();
+        }
+        for (int n = matrix.starts[i]; n < matrix.starts[i + 1]; n++) {
+            row[matrix.indices[n]] = matrix.values[n];
+        }
+    }
+}
+
+//CSR to CSC and back (counting sort of nonzeros by column), indices in every line stay sorted
+template <typename T>
+static void TransposeSparse(const SparseMatrix<T>& matrix, SparseMatrix<T>& transposed) {
+    int nonzeros = SparseNonzeros(matrix);
+    InitSparse(transposed, matrix.cols, matrix.rows, nonzeros);
+
+    memset(transposed.starts, 0, (matrix.cols + 1) * sizeof (int));
+    for (int n = 0; n < nonzeros; n++) {
+        transposed.starts[matrix.indices[n] + 1]++;
+    }
+    for (int j = 0; j < matrix.cols; j++) {
+        transposed.starts[j + 1] += transposed.starts[j];
+    }
+
+    int* next = new int[matrix.cols + 1];
+    memcpy(next, transposed.starts, (matrix.cols + 1) * sizeof (int));
+    for (int i = 0; i < matrix.rows; i++) {
+        for (int n = matrix.starts[i]; n < matrix.starts[i + 1]; n++) {
+            int position = next[matrix.indices[n]]++;
+            transposed.indices[position] = i;
+            transposed.values[position] = matrix.values[n];
+        }
+    }
+    delete[] next;
+}
+
+//first row of process in balanced layout
+static int SparseRowStart(int totalRows, int processes, int rank) {
+    int base = totalRows / processes;
+    int extra = totalRows % processes;
+    return rank * base + ((rank < extra) ? rank : extra);
+}
+
+static int SparseRowCount(int totalRows, int processes, int rank) {
+    return SparseRowStart(totalRows, processes, rank + 1) - SparseRowStart(totalRows, processes, rank);
+}
+
+//process which has row
+static int SparseRowOwner(int totalRows, int processes, int row) {
+    int base = totalRows / processes;
+    int extra = totalRows % processes;
+    if (row < extra * (base + 1)) return row / (base + 1);
+    return extra + (row - extra * (base + 1)) / base;
+}
+
+//C += A * B, A is sparse, B and C are dense with width elements in row
+//rows of C are divided between threads (if compiled with OpenMP)
+template <typename T>
+static void SparseMultiplyAdd(const SparseMatrix<T>& a, const T* b, int width, typename Element<T>::Acc* c) {
+    typedef typename Element<T>::Acc Acc;
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < a.rows; i++) {
+        Acc* rowC = c + (long) i * width;
+        for (int n = a.starts[i]; n < a.starts[i + 1]; n++) {
+            const T* rowB = b + (long) a.indices[n] * width;
+            Acc value = Element<T>::ToAcc(a.values[n]);
+            for (int j = 0; j < width; j++) {
+                rowC[j] += value * Element<T>::ToAcc(rowB[j]);
+            }
+        }
+    }
+}
+
+//sends blocks of rows of sparse matrix from process 0 to all processes (collective)
+//matrix is used only on process 0 of comm
+template <typename T>
+static void ScatterSparseRows(const SparseMatrix<T>* matrix, int totalRows, int cols, MPI_Comm comm, SparseMatrix<T>& block) {
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+    int rows = SparseRowCount(totalRows, mpi_size, mpi_rank);
+
+    //lengths of rows and nonzeros of blocks of processes
+    int *rowCounts = NULL, *rowDispls = NULL, *counts = NULL, *displs = NULL, *lengths = NULL;
+    if (mpi_rank == 0) {
+        rowCounts = new int[mpi_size];
+        rowDispls = new int[mpi_size];
+        counts = new int[mpi_size];
+        displs = new int[mpi_size];
+        lengths = new int[totalRows + 1];
+        for (int p = 0; p < mpi_size; p++) {
+            rowDispls[p] = SparseRowStart(totalRows, mpi_size, p);
+            rowCounts[p] = SparseRowCount(totalRows, mpi_size, p);
+            displs[p] = matrix->starts[rowDispls[p]];
+            counts[p] = matrix->starts[rowDispls[p] + rowCounts[p]] - displs[p];
+        }
+        for (int i = 0; i < totalRows; i++) {
+            lengths[i] = matrix->starts[i + 1] - matrix->starts[i];
+        }
+    }
+
+    metrics.Start(phaseScatter);
+    int nonzeros;
+    MPI_Scatter(counts, 1, MPI_INT, &nonzeros, 1, MPI_INT, 0, comm);
+    InitSparse(block, rows, cols, nonzeros);
+
+    MPI_Scatterv(lengths, rowCounts, rowDispls, MPI_INT, block.starts + 1, rows, MPI_INT, 0, comm);
+    MPI_Scatterv((mpi_rank == 0) ? matrix->indices : NULL, counts, displs, MPI_INT, block.indices, nonzeros, MPI_INT, 0, comm);
+    MPI_Scatterv((mpi_rank == 0) ? matrix->values : NULL, counts, displs, Element<T>::Type(), block.values, nonzeros, Element<T>::Type(), 0, comm);
+    metrics.Stop(phaseScatter);
+    metrics.AddBytes(callScatter, ((long) rows + nonzeros) * sizeof (int) + (long) nonzeros * sizeof (T));
+
+    for (int i = 0; i < rows; i++) {
+        block.starts[i + 1] += block.starts[i];
+    }
+
+    if (mpi_rank == 0) {
+        delete[] rowCounts;
+        delete[] rowDispls;
+        delete[] counts;
+        delete[] displs;
+        delete[] lengths;
+    }
+}
+
+//sends or gathers blocks of rows of dense matrix with width elements in row between process 0
+//and all processes in balanced layout (collective), matrix is used only on process 0 of comm
+template <typename T>
+static void ExchangeDenseRows(T* matrix, int totalRows, int width, T* block, bool gather, MPI_Comm comm) {
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+    int count = SparseRowCount(totalRows, mpi_size, mpi_rank) * width;
+
+    int *counts = NULL, *displs = NULL;
+    if (mpi_rank == 0) {
+        counts = new int[mpi_size];
+        displs = new int[mpi_size];
+        for (int p = 0; p < mpi_size; p++) {
+            counts[p] = SparseRowCount(totalRows, mpi_size, p) * width;
+            displs[p] = SparseRowStart(totalRows, mpi_size, p) * width;
+        }
+    }
+
+    if (gather) {
+        metrics.Start(phaseGather);
+        MPI_Gatherv(block, count, Element<T>::Type(), matrix, counts, displs, Element<T>::Type(), 0, comm);
+        metrics.Stop(phaseGather);
+        metrics.AddBytes(callGather, (long) count * sizeof (T));
+    } else {
+        metrics.Start(phaseScatter);
+        MPI_Scatterv(matrix, counts, displs, Element<T>::Type(), block, count, Element<T>::Type(), 0, comm);
+        metrics.Stop(phaseScatter);
+        metrics.AddBytes(callScatter, (long) count * sizeof (T));
+    }
+
+    if (mpi_rank == 0) {
+        delete[] counts;
+        delete[] displs;
+    }
+}
+
+//which rows of B process exchanges with other processes
+template <typename T>
+struct SparsePlan {
+    int width; //elements in row of B and C
+    SparseMatrix<T> localPart; //nonzeros of block of A with local columns, columns are local rows of B
+    SparseMatrix<T> remotePart; //other nonzeros, columns are indices of received rows of B
+
+    //processes which send rows to this process: ranks, counts of rows and their offsets in received rows
+    int receiveNeighbors;
+    int *receiveRanks, *receiveCounts, *receiveOffsets;
+    //processes which need rows of this process, sendRows are local indices of rows sent to them
+    int sendNeighbors;
+    int *sendRanks, *sendCounts, *sendOffsets, *sendRows;
+
+    T *receiveBuffer, *sendBuffer;
+    MPI_Request* requests;
+};
+
+//keeps ranks, counts and offsets of processes with nonzero counts
+static int PackNeighbors(const int* counts, const int* displs, int processes, int* ranks, int* neighborCounts, int* offsets) {
+    int n = 0;
+    for (int p = 0; p < processes; p++) {
+        if (counts[p] == 0) continue;
+        ranks[n] = p;
+        neighborCounts[n] = counts[p];
+        offsets[n] = displs[p];
+        n++;
+    }
+    return n;
+}
+
+//builds communication plan for block of rows of A (collective)
+template <typename T>
+static void BuildSparsePlan(const SparseMatrix<T>& block, int totalRows, int width, MPI_Comm comm, SparsePlan<T>& plan) {
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+    int rowStart = SparseRowStart(totalRows, mpi_size, mpi_rank);
+    int rowEnd = rowStart + block.rows;
+    plan.width = width;
+
+    //columns with nonzeros in order, so needed rows of B are grouped by processes which have them
+    SparseMatrix<T> columns;
+    TransposeSparse(block, columns);
+
+    int* receiveCounts = new int[mpi_size];
+    int* sendCounts = new int[mpi_size];
+    memset(receiveCounts, 0, mpi_size * sizeof (int));
+    int* neededRows = new int[block.cols + 1];
+    int* remoteIndex = new int[block.cols + 1]; //index of column in received rows
+    int received = 0;
+    for (int j = 0; j < block.cols; j++) {
+        if (columns.starts[j] == columns.starts[j + 1] || (j >= rowStart && j < rowEnd)) continue;
+        receiveCounts[SparseRowOwner(totalRows, mpi_size, j)]++;
+        remoteIndex[j] = received;
+        neededRows[received++] = j;
+    }
+    FreeSparse(columns);
+
+    //every process learns which of its rows are needed by others
+    metrics.Start(phaseShift);
+    MPI_Alltoall(receiveCounts, 1, MPI_INT, sendCounts, 1, MPI_INT, comm);
+    metrics.AddBytes(callAlltoall, (long) mpi_size * sizeof (int));
+
+    int* receiveDispls = new int[mpi_size];
+    int* sendDispls = new int[mpi_size];
+    int sent = 0;
+    for (int p = 0, r = 0; p < mpi_size; p++) {
+        receiveDispls[p] = r;
+        sendDispls[p] = sent;
+        r += receiveCounts[p];
+        sent += sendCounts[p];
+    }
+    plan.sendRows = new int[sent + 1];
+    MPI_Alltoallv(neededRows, receiveCounts, receiveDispls, MPI_INT, plan.sendRows, sendCounts, sendDispls, MPI_INT, comm);
+    metrics.Stop(phaseShift);
+    metrics.AddBytes(callAlltoall, (long) received * sizeof (int));
+    for (int i = 0; i < sent; i++) {
+        plan.sendRows[i] -= rowStart;
+    }
+
+    plan.receiveRanks = new int[mpi_size];
+    plan.receiveCounts = new int[mpi_size];
+    plan.receiveOffsets = new int[mpi_size];
+    plan.receiveNeighbors = PackNeighbors(receiveCounts, receiveDispls, mpi_size, plan.receiveRanks, plan.receiveCounts, plan.receiveOffsets);
+    plan.sendRanks = new int[mpi_size];
+    plan.sendCounts = new int[mpi_size];
+    plan.sendOffsets = new int[mpi_size];
+    plan.sendNeighbors = PackNeighbors(sendCounts, sendDispls, mpi_size, plan.sendRanks, plan.sendCounts, plan.sendOffsets);
+
+    //nonzeros are divided to local and remote parts with columns renumbered to rows of their buffers
+    int localNonzeros = 0, nonzeros = SparseNonzeros(block);
+    for (int n = 0; n < nonzeros; n++) {
+        if (block.indices[n] >= rowStart && block.indices[n] < rowEnd) localNonzeros++;
+    }
+    InitSparse(plan.localPart, block.rows, block.rows, localNonzeros);
+    InitSparse(plan.remotePart, block.rows, received, nonzeros - localNonzeros);
+    int l = 0, r = 0;
+    for (int i = 0; i < block.rows; i++) {
+        for (int n = block.starts[i]; n < block.starts[i + 1]; n++) {
+            int j = block.indices[n];
+            if (j >= rowStart && j < rowEnd) {
+                plan.localPart.indices[l] = j - rowStart;
+                plan.localPart.values[l++] = block.values[n];
+            } else {
+                plan.remotePart.indices[r] = remoteIndex[j];
+                plan.remotePart.values[r++] = block.values[n];
+            }
+        }
+        plan.localPart.starts[i + 1] = l;
+        plan.remotePart.starts[i + 1] = r;
+    }
+
+    plan.receiveBuffer = new T[(long) received * width + 1];
+    plan.sendBuffer = new T[(long) sent * width + 1];
+    plan.requests = new MPI_Request[plan.receiveNeighbors + plan.sendNeighbors + 1];
+
+    delete[] receiveCounts;
+    delete[] sendCounts;
+    delete[] receiveDispls;
+    delete[] sendDispls;
+    delete[] neededRows;
+    delete[] remoteIndex;
+}
+
+template <typename T>
+static void FreeSparsePlan(SparsePlan<T>& plan) {
+    FreeSparse(plan.localPart);
+    FreeSparse(plan.remotePart);
+    delete[] plan.receiveRanks;
+    delete[] plan.receiveCounts;
+    delete[] plan.receiveOffsets;
+    delete[] plan.sendRanks;
+    delete[] plan.sendCounts;
+    delete[] plan.sendOffsets;
+    delete[] plan.sendRows;
+    delete[] plan.receiveBuffer;
+    delete[] plan.sendBuffer;
+    delete[] plan.requests;
+}
+
+//C = A * B for blocks of rows of this process with plan of block of A (collective)
+template <typename T>
+static void MultiplySparse(SparsePlan<T>& plan, const T* blockB, typename Element<T>::Acc* blockC, MPI_Comm comm) {
+    MPI_Datatype type = Element<T>::Type();
+    int width = plan.width;
+    int requestCount = 0;
+    long moved = 0;
+
+    metrics.Start(phaseShift);
+    for (int i = 0; i < plan.receiveNeighbors; i++) {
+        MPI_Irecv(plan.receiveBuffer + (long) plan.receiveOffsets[i] * width, plan.receiveCounts[i] * width, type,
+                plan.receiveRanks[i], sparseTag, comm, &(plan.requests[requestCount++]));
+    }
+    for (int i = 0; i < plan.sendNeighbors; i++) {
+        T* packed = plan.sendBuffer + (long) plan.sendOffsets[i] * width;
+        for (int k = 0; k < plan.sendCounts[i]; k++) {
+            memcpy(packed + (long) k * width, blockB + (long) plan.sendRows[plan.sendOffsets[i] + k] * width, width * sizeof (T));
+        }
+        MPI_Isend(packed, plan.sendCounts[i] * width, type, plan.sendRanks[i], sparseTag, comm, &(plan.requests[requestCount++]));
+        moved += (long) plan.sendCounts[i] * width;
+    }
+    metrics.Stop(phaseShift);
+    metrics.AddBytes(callSend, moved * sizeof (T));
+    metrics.AddBytes(callRecv, (long) plan.remotePart.cols * width * sizeof (T));
+
+    //local columns while rows of other processes are transferred
+    metrics.Start(phaseCompute);
+    memset(blockC, 0, (long) plan.localPart.rows * width * sizeof (typename Element<T>::Acc));
+    SparseMultiplyAdd(plan.localPart, blockB, width, blockC);
+    metrics.Stop(phaseCompute);
+
+    metrics.Start(phaseShift);
+    MPI_Waitall(requestCount, plan.requests, MPI_STATUSES_IGNORE);
+    metrics.Stop(phaseShift);
+
+    metrics.Start(phaseCompute);
+    SparseMultiplyAdd(plan.remotePart, plan.receiveBuffer, width, blockC);
+    metrics.Stop(phaseCompute);
+}
+
+#endif /* SPARSE_H */
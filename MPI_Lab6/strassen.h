@@ -0,0 +1,278 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <mpich/mpi.h>
+#include <string.h>
+#include <math.h>
+#include "kernel.h"
+#include "summa.h"
+#include "../common/metrics.h"
+
+//multiplication of matrices with Strassen-Winograd method: 7 products of half matrices instead of 8
+//and 15 additions per level of recursion
+//matrices of odd rank are padded with zeros to even rank on every level
+//on distributed level processes are divided to min(7, processes) groups, product k goes to group k % groups,
+//group multiplies its products with next level of recursion on its own communicator
+//when levels are over or matrices are smaller than strassenCutoff, group uses SUMMA
+//(or blocked kernel if group is one process)
+//all calculations are in type of calculations A, so additions of fp16 and bf16 aren't rounded
+//matrix B is transposed! transposed block (i, j) of B is block (j, i) of transposed matrix
+
+const int strassenCutoff = 128; //smaller matrices are multiplied with classic method
+const int strassenProducts = 7;
+
+enum StrassenTags {
+    strassenTagOperands = 3,
+    strassenTagProduct = 4
+};
+
+//dst = a + sign * b, count elements
+template <typename A>
+static void AddMatrices(const A* a, const A* b, int sign, long count, A* dst) {
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < count; i++) {
+        dst[i] = (sign > 0) ? a[i] + b[i] : a[i] - b[i];
+    }
+}
+
+//allocates operands of 7 products for matrices X and transposed Y of rank n, blocks have rank h:
+//S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21, S4 = A12 - S2
+//T1 = B12 - B11, T2 = B22 - T1, T3 = B22 - B12, T4 = T2 - B21
+//P1 = A11 B11, P2 = A12 B21, P3 = S4 B22, P4 = A22 T4, P5 = S1 T1, P6 = S2 T2, P7 = S3 T3
+template <typename A>
+static void WinogradSplit(const A* X, const A* Yt, int n, int h, A** xs, A** ys) {
+    long count = (long) h * h;
+    for (int k = 0; k < strassenProducts; k++) {
+        xs[k] = new A[count];
+        ys[k] = new A[count];
+    }
+
+    //blocks of X are put to operands which are used as is
+    PackPadded(X, n, 0, 0, h, h, xs[0]); //A11
+    PackPadded(X, n, 0, h, h, h, xs[1]); //A12
+    PackPadded(X, n, h, h, h, h, xs[3]); //A22
+    A* a21 = new A[count];
+    PackPadded(X, n, h, 0, h, h, a21);
+    AddMatrices(a21, xs[3], 1, count, xs[4]); //S1
+    AddMatrices(xs[4], xs[0], -1, count, xs[5]); //S2
+    AddMatrices(xs[0], a21, -1, count, xs[6]); //S3
+    AddMatrices(xs[1], xs[5], -1, count, xs[2]); //S4
+
+    PackPadded(Yt, n, 0, 0, h, h, ys[0]); //B11
+    PackPadded(Yt, n, 0, h, h, h, ys[1]); //B21
+    PackPadded(Yt, n, h, h, h, h, ys[2]); //B22
+    A* b12 = new A[count];
+    PackPadded(Yt, n, h, 0, h, h, b12);
+    AddMatrices(b12, ys[0], -1, count, ys[4]); //T1
+    AddMatrices(ys[2], ys[4], -1, count, ys[5]); //T2
+    AddMatrices(ys[2], b12, -1, count, ys[6]); //T3
+    AddMatrices(ys[5], ys[1], -1, count, ys[3]); //T4
+
+    delete[] a21;
+    delete[] b12;
+}
+
+//Z from products of rank h, products are changed:
+//U2 = P1 + P6, U3 = U2 + P7, U4 = U2 + P5
+//C11 = P1 + P2, C12 = U4 + P3, C21 = U3 - P4, C22 = U3 + P5
+template <typename A>
+static void WinogradCombine(A** ps, int n, int h, A* Z) {
+    long count = (long) h * h;
+    AddMatrices(ps[0], ps[5], 1, count, ps[5]); //U2
+    AddMatrices(ps[0], ps[1], 1, count, ps[0]); //C11
+    AddMatrices(ps[5], ps[6], 1, count, ps[6]); //U3
+    AddMatrices(ps[5], ps[4], 1, count, ps[5]); //U4
+    AddMatrices(ps[5], ps[2], 1, count, ps[2]); //C12
+    AddMatrices(ps[6], ps[3], -1, count, ps[3]); //C21
+    AddMatrices(ps[6], ps[4], 1, count, ps[4]); //C22
+
+    //blocks without padding
+    A* blocks[4] = {ps[0], ps[2], ps[3], ps[4]};
+    for (int b = 0; b < 4; b++) {
+        int row0 = (b / 2) * h, col0 = (b % 2) * h;
+        int cols = (n - col0 < h) ? n - col0 : h;
+        for (int i = 0; i < h && row0 + i < n; i++) {
+            memcpy(Z + (long) (row0 + i) * n + col0, blocks[b] + (long) i * h, cols * sizeof (A));
+        }
+    }
+}
+
+//Z = X * Y on one process, Y is transposed
+template <typename A>
+static void StrassenLocal(const A* X, const A* Yt, A* Z, int n, int levels) {
+    if (levels == 0 || n < strassenCutoff) {
+        MultiplyBlock(X, n, Yt, n, Z, n, n, n, n);
+        return;
+    }
+
+    int h = (n + 1) / 2;
+    A *xs[strassenProducts], *ys[strassenProducts], *ps[strassenProducts];
+    WinogradSplit(X, Yt, n, h, xs, ys);
+    for (int k = 0; k < strassenProducts; k++) {
+        ps[k] = new A[(long) h * h];
+        StrassenLocal(xs[k], ys[k], ps[k], h, levels - 1);
+        delete[] xs[k];
+        delete[] ys[k];
+    }
+    WinogradCombine(ps, n, h, Z);
+    for (int k = 0; k < strassenProducts; k++) {
+        delete[] ps[k];
+    }
+}
+
+//Z = X * Y, X, Y (transposed) and Z are used only on process 0 of comm
+template <typename A>
+static void StrassenDistributed(const A* X, const A* Yt, A* Z, int n, int levels, MPI_Comm comm) {
+    MPI_Datatype type = Element<A>::Type();
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+
+    if (mpi_size == 1) {
+        metrics.Start(phaseCompute);
+        StrassenLocal(X, Yt, Z, n, levels);
+        metrics.Stop(phaseCompute);
+        return;
+    }
+    if (levels == 0 || n < strassenCutoff) {
+        MultiplySumma(X, Yt, Z, n, comm, NULL);
+        return;
+    }
+
+    //groups of processes, process g is root of group g
+    int groups = (mpi_size < strassenProducts) ? mpi_size : strassenProducts;
+    int group = mpi_rank % groups;
+    MPI_Comm groupComm;
+    MPI_Comm_split(comm, group, mpi_rank, &groupComm);
+
+    int h = (n + 1) / 2;
+    long count = (long) h * h;
+    A *xs[strassenProducts], *ys[strassenProducts], *ps[strassenProducts];
+    for (int k = 0; k < strassenProducts; k++) {
+        xs[k] = ys[k] = ps[k] = NULL;
+    }
+
+    //operands go to roots of groups
+    MPI_Request requests[2 * strassenProducts];
+    int requestCount = 0;
+    if (mpi_rank == 0) {
+        metrics.Start(phaseCompute);
+        WinogradSplit(X, Yt, n, h, xs, ys);
+        metrics.Stop(phaseCompute);
+    }
+    metrics.Start(phaseScatter);
+    for (int k = 0; k < strassenProducts; k++) {
+        int root = k % groups;
+        if (root == 0) continue;
+        if (mpi_rank == 0) {
+            MPI_Isend(xs[k], count, type, root, strassenTagOperands, comm, &requests[requestCount++]);
+            MPI_Isend(ys[k], count, type, root, strassenTagOperands, comm, &requests[requestCount++]);
+            metrics.AddBytes(callSend, 2 * count * sizeof (A));
+        } else if (mpi_rank == root) {
+            xs[k] = new A[count];
+            ys[k] = new A[count];
+            MPI_Irecv(xs[k], count, type, 0, strassenTagOperands, comm, &requests[requestCount++]);
+            MPI_Irecv(ys[k], count, type, 0, strassenTagOperands, comm, &requests[requestCount++]);
+            metrics.AddBytes(callRecv, 2 * count * sizeof (A));
+        }
+    }
+    MPI_Waitall(requestCount, requests, MPI_STATUSES_IGNORE);
+    metrics.Stop(phaseScatter);
+    if (mpi_rank == 0) {
+        for (int k = 0; k < strassenProducts; k++) {
+            if (k % groups == 0) continue;
+            delete[] xs[k];
+            delete[] ys[k];
+            xs[k] = ys[k] = NULL;
+        }
+    }
+
+    //every group multiplies its products
+    for (int k = group; k < strassenProducts; k += groups) {
+        if (mpi_rank == group) ps[k] = new A[count];
+        StrassenDistributed(xs[k], ys[k], ps[k], h, levels - 1, groupComm);
+        if (xs[k] != NULL) delete[] xs[k];
+        if (ys[k] != NULL) delete[] ys[k];
+        xs[k] = ys[k] = NULL;
+    }
+    MPI_Comm_free(&groupComm);
+
+    //products go back to process 0
+    requestCount = 0;
+    metrics.Start(phaseGather);
+    for (int k = 0; k < strassenProducts; k++) {
+        int root = k % groups;
+        if (root == 0) continue;
+        if (mpi_rank == 0) {
+            ps[k] = new A[count];
+            MPI_Irecv(ps[k], count, type, root, strassenTagProduct, comm, &requests[requestCount++]);
+            metrics.AddBytes(callRecv, count * sizeof (A));
+        } else if (mpi_rank == root) {
+            MPI_Isend(ps[k], count, type, 0, strassenTagProduct, comm, &requests[requestCount++]);
+            metrics.AddBytes(callSend, count * sizeof (A));
+        }
+    }
+    MPI_Waitall(requestCount, requests, MPI_STATUSES_IGNORE);
+    metrics.Stop(phaseGather);
+
+    if (mpi_rank == 0) {
+        metrics.Start(phaseCompute);
+        WinogradCombine(ps, n, h, Z);
+        metrics.Stop(phaseCompute);
+    }
+    for (int k = 0; k < strassenProducts; k++) {
+        if (ps[k] != NULL) delete[] ps[k];
+    }
+}
+
+//multiplication of matrices of elements T with Strassen-Winograd method
+//matrixA, matrixB and matrixC are used only on process 0 of comm
+//A and B are converted to type of calculations once, so all levels work with Acc
+template <typename T>
+static void MultiplyStrassen(const T* matrixA, const T* matrixB, typename Element<T>::Acc* matrixC, int matrixRank, int levels, MPI_Comm comm) {
+    typedef typename Element<T>::Acc Acc;
+    int mpi_rank;
+    MPI_Comm_rank(comm, &mpi_rank);
+
+    long size = (long) matrixRank * matrixRank;
+    Acc *accA = NULL, *accB = NULL;
+    if (mpi_rank == 0) {
+        accA = new Acc[size];
+        accB = new Acc[size];
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < size; i++) {
+            accA[i] = Element<T>::ToAcc(matrixA[i]);
+            accB[i] = Element<T>::ToAcc(matrixB[i]);
+        }
+    }
+
+    StrassenDistributed(accA, accB, matrixC, matrixRank, levels, comm);
+
+    if (mpi_rank == 0) {
+        delete[] accA;
+        delete[] accB;
+    }
+}
+
+//max difference of result from result of classic method relative to max element of classic result
+template <typename A>
+static double MaxRelativeError(const A* result, const A* classic, long count) {
+    double maxDifference = 0, maxElement = 0;
+    for (long i = 0; i < count; i++) {
+        double difference = fabs((double) result[i] - (double) classic[i]);
+        if (difference > maxDifference) maxDifference = difference;
+        if (fabs((double) classic[i]) > maxElement) maxElement = fabs((double) classic[i]);
+    }
+    return (maxElement > 0) ? maxDifference / maxElement : maxDifference;
+}
+
+//allowed max relative error of Strassen method for tolerance of classic method:
+//bound of error grows with every level of recursion (about 4 times for Winograd's variant)
+static double StrassenTolerance(double tolerance, int levels) {
+    for (int l = 0; l < levels; l++) {
+        tolerance *= 4;
+    }
+    return tolerance;
+}
+
+#endif /* STRASSEN_H */
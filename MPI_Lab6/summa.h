@@ -0,0 +1,182 @@
+#ifndef SUMMA_H
+#define SUMMA_H
+
+#include <mpich/mpi.h>
+#include <string.h>
+#include "kernel.h"
+#include "../common/binfile.h"
+#include "../common/metrics.h"
+
+//multiplication of matrices with SUMMA method on 2D grid of processes
+//matrices are padded with zeros, so rank of matrices can be any
+//process with grid coordinates (i, j) holds block (i, j) of A and C
+//and block (j, i) of B (matrix B is transposed!)
+//on each step one column of grid broadcasts panel of A along rows of grid
+//and one row of grid broadcasts panel of B along columns of grid
+
+static int GreatestCommonDivisor(int a, int b) {
+    while (b != 0) {
+        int temp = a % b;
+        a = b;
+        b = temp;
+    }
+    return a;
+}
+
+//copies rows x cols block from square matrix to continuous memory
+//rows and columns out of matrix of rank matrixRank are filled with zeros
+template <typename T>
+static void PackPadded(const T* matrix, int matrixRank, int row0, int col0, int rows, int cols, T* dst) {
+    for (int i = 0; i < rows; i++) {
+        int count = (row0 + i < matrixRank) ? matrixRank - col0 : 0;
+        if (count > cols) count = cols;
+        if (count < 0) count = 0;
+
+        if (count > 0) memcpy(dst + i * cols, matrix + (row0 + i) * matrixRank + col0, count * sizeof (T));
+        memset(dst + i * cols + count, 0, (cols - count) * sizeof (T));
+    }
+}
+
+//matrixA, matrixB and matrixC are used only on process 0 of comm
+//if files are given, processes read and write their blocks of matrices directly
+//panels of A and B are sent with elements of type T, blocks of C have elements of type Acc
+template <typename T>
+static void MultiplySumma(const T* matrixA, const T* matrixB, typename Element<T>::Acc* matrixC, int matrixRank, MPI_Comm comm, const MatrixFiles* files) {
+    typedef typename Element<T>::Acc Acc;
+    MPI_Datatype type = Element<T>::Type(), accType = Element<Acc>::Type();
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+
+    //create grid of processes
+    int dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    MPI_Dims_create(mpi_size, 2, dims);
+
+    MPI_Comm gridComm, rowComm, colComm;
+    MPI_Cart_create(comm, 2, dims, periods, 0, &gridComm);
+    MPI_Cart_coords(gridComm, mpi_rank, 2, coords);
+
+    int remainRow[2] = {0, 1}, remainCol[2] = {1, 0};
+    MPI_Cart_sub(gridComm, remainRow, &rowComm); //rank in rowComm is column of grid
+    MPI_Cart_sub(gridComm, remainCol, &colComm); //rank in colComm is row of grid
+
+    //padded rank must be divisible by both dims of grid
+    int panels = dims[0] / GreatestCommonDivisor(dims[0], dims[1]) * dims[1];
+    int paddedRank = (matrixRank + panels - 1) / panels * panels;
+    int panelDepth = paddedRank / panels;
+
+    int blockRowsA = paddedRank / dims[0]; //rows of A and C per process
+    int blockColsB = paddedRank / dims[1]; //rows of B (columns of C) per process
+    int depthA = paddedRank / dims[1]; //part of row of A per process
+    int depthB = paddedRank / dims[0]; //part of row of B per process
+
+    int elemsA = blockRowsA * depthA;
+    int elemsB = blockColsB * depthB;
+    int elemsC = blockRowsA * blockColsB;
+
+    T* bufferA = AllocateTouched<T>(elemsA);
+    T* bufferB = AllocateTouched<T>(elemsB);
+    Acc* bufferC = AllocateTouched<Acc>(elemsC);
+    T* panelA = AllocateTouched<T>(blockRowsA * panelDepth);
+    T* panelB = AllocateTouched<T>(blockColsB * panelDepth);
+
+    //send blocks of matrices to all processes
+    bool readInput = files != NULL && files->readInput;
+    bool writeOutput = files != NULL && files->writeOutput;
+    T *sendA = NULL, *sendB = NULL;
+    Acc* recvC = NULL;
+    if (readInput) {
+        metrics.Start(phaseIO);
+        ReadMatrixBlock(files->fileA, files->headerA, false, coords[0] * blockRowsA, coords[1] * depthA, blockRowsA, depthA, bufferA, depthA);
+        ReadMatrixBlock(files->fileB, files->headerB, true, coords[1] * blockColsB, coords[0] * depthB, blockColsB, depthB, bufferB, depthB);
+        metrics.Stop(phaseIO);
+        metrics.AddBytes(callFileRead, ((long) elemsA + elemsB) * sizeof (T));
+    } else {
+        metrics.Start(phaseScatter);
+        if (mpi_rank == 0) {
+            sendA = new T[(long) elemsA * mpi_size];
+            sendB = new T[(long) elemsB * mpi_size];
+
+            for (int p = 0; p < mpi_size; p++) {
+                int c[2];
+                MPI_Cart_coords(gridComm, p, 2, c);
+                PackPadded(matrixA, matrixRank, c[0] * blockRowsA, c[1] * depthA, blockRowsA, depthA, sendA + (long) p * elemsA);
+                PackPadded(matrixB, matrixRank, c[1] * blockColsB, c[0] * depthB, blockColsB, depthB, sendB + (long) p * elemsB);
+            }
+        }
+
+        MPI_Scatter(sendA, elemsA, type, bufferA, elemsA, type, 0, gridComm);
+        MPI_Scatter(sendB, elemsB, type, bufferB, elemsB, type, 0, gridComm);
+        metrics.Stop(phaseScatter);
+        metrics.AddBytes(callScatter, ((long) elemsA + elemsB) * sizeof (T));
+    }
+
+    for (int p = 0; p < panels; p++) {
+        int k0 = p * panelDepth;
+
+        //column of grid with this panel of A broadcasts it along row
+        metrics.Start(phaseBroadcast);
+        int ownerA = k0 / depthA;
+        if (coords[1] == ownerA) {
+            PackRows(bufferA, depthA, blockRowsA, k0 - ownerA * depthA, panelDepth, panelA);
+        }
+        MPI_Bcast(panelA, blockRowsA * panelDepth, type, ownerA, rowComm);
+
+        //row of grid with this panel of B broadcasts it along column
+        int ownerB = k0 / depthB;
+        if (coords[0] == ownerB) {
+            PackRows(bufferB, depthB, blockColsB, k0 - ownerB * depthB, panelDepth, panelB);
+        }
+        MPI_Bcast(panelB, blockColsB * panelDepth, type, ownerB, colComm);
+        metrics.Stop(phaseBroadcast);
+        metrics.AddBytes(callBcast, ((long) blockRowsA + blockColsB) * panelDepth * sizeof (T));
+
+        metrics.Start(phaseCompute);
+        MultiplyAddBlock(panelA, panelDepth, panelB, panelDepth, bufferC, blockColsB, blockRowsA, blockColsB, panelDepth);
+        metrics.Stop(phaseCompute);
+    }
+
+    //gather blocks of matrix C and remove padding
+    if (writeOutput) {
+        metrics.Start(phaseIO);
+        WriteMatrixBlock(files->fileC, files->headerC, coords[0] * blockRowsA, coords[1] * blockColsB, blockRowsA, blockColsB, bufferC, blockColsB);
+        metrics.Stop(phaseIO);
+        metrics.AddBytes(callFileWrite, (long) elemsC * sizeof (Acc));
+    } else {
+        metrics.Start(phaseGather);
+        if (mpi_rank == 0) recvC = new Acc[(long) elemsC * mpi_size];
+        MPI_Gather(bufferC, elemsC, accType, recvC, elemsC, accType, 0, gridComm);
+        metrics.Stop(phaseGather);
+        metrics.AddBytes(callGather, (long) elemsC * sizeof (Acc));
+    }
+
+    if (mpi_rank == 0 && !writeOutput) {
+        for (int p = 0; p < mpi_size; p++) {
+            int c[2];
+            MPI_Cart_coords(gridComm, p, 2, c);
+            for (int i = 0; i < blockRowsA && c[0] * blockRowsA + i < matrixRank; i++) {
+                int col0 = c[1] * blockColsB;
+                int count = (matrixRank - col0 < blockColsB) ? matrixRank - col0 : blockColsB;
+                if (count > 0) {
+                    memcpy(matrixC + (c[0] * blockRowsA + i) * matrixRank + col0, recvC + (long) p * elemsC + i * blockColsB, count * sizeof (Acc));
+                }
+            }
+        }
+    }
+
+    if (sendA != NULL) delete[] sendA;
+    if (sendB != NULL) delete[] sendB;
+    if (recvC != NULL) delete[] recvC;
+
+    delete[] bufferA;
+    delete[] bufferB;
+    delete[] bufferC;
+    delete[] panelA;
+    delete[] panelB;
+
+    MPI_Comm_free(&rowComm);
+    MPI_Comm_free(&colComm);
+    MPI_Comm_free(&gridComm);
+}
+
+#endif /* SUMMA_H */
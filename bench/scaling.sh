@@ -0,0 +1,83 @@
+#!/bin/bash
+#strong and weak scaling sweeps of lab4 and lab6 on one host
+#
+#usage: scaling.sh strong|weak lab4|lab6 binary "processes..." size [options of program...]
+#  strong: size is full array size (lab4) or matrix rank (lab6) for all counts of processes
+#  weak:   size is array size per process (lab4) or matrix rank for 1 process (lab6),
+#          for p processes rank of matrices is size * p^(1/3), so work per process is the same
+#options of program (-m, -o, -w, -r, -x ...) are passed as is
+#
+#example: scaling.sh strong lab6 MPI_Lab6/dist/Release/GNU-Linux/mpi_lab6 "1 2 4 8" 1200 -m summa -w 1 -r 5
+#
+#result is csv on stdout, speedup and efficiency are relative to first count of processes
+#exit code is 1 if result of any run is not equal to linear method
+#environment: MPIRUN (default mpirun), MPIRUN_FLAGS (default --oversubscribe)
+
+if [ $# -lt 5 ]; then
+    sed -n '2,14p' "$0" | sed 's/^#//'
+    exit 2
+fi
+
+mode=$1
+program=$2
+binary=$3
+processes=$4
+size=$5
+shift 5
+
+MPIRUN=${MPIRUN:-mpirun}
+MPIRUN_FLAGS=${MPIRUN_FLAGS:---oversubscribe}
+
+#size of problem given to program for p processes
+ProblemSize() {
+    local p=$1
+    if [ "$program" = "lab4" ]; then
+        if [ "$mode" = "strong" ]; then
+            echo $((size / p))
+        else
+            echo "$size"
+        fi
+    else
+        #ribbon method needs rank divisible by count of processes
+        awk -v n="$size" -v p="$p" -v mode="$mode" 'BEGIN {
+            if (mode == "weak") n = n * exp(log(p) / 3);
+            n = int((n + p - 1) / p) * p;
+            print n
+        }'
+    fi
+}
+
+#value of key from line "Benchmark: key=value ..."
+Field() {
+    echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+echo "mode,program,processes,threads,size,mean,stddev,gflops,gbs,speedup,efficiency,check"
+
+failed=0
+baseProcesses=""
+baseRate=""
+for p in $processes; do
+    line=$($MPIRUN $MPIRUN_FLAGS -np "$p" "$binary" -n "$(ProblemSize "$p")" "$@" | grep "^Benchmark:")
+    if [ -z "$line" ]; then
+        echo "run with $p processes failed" >&2
+        failed=1
+        continue
+    fi
+
+    gflops=$(Field "$line" gflops)
+    check=$(Field "$line" check)
+    if [ -z "$baseRate" ]; then
+        baseProcesses=$p
+        baseRate=$gflops
+    fi
+
+    #rate of work is compared, so same formulas are used for strong and weak scaling
+    speedup=$(awk -v r="$gflops" -v b="$baseRate" 'BEGIN { printf "%.3f", (b > 0) ? r / b : 0 }')
+    efficiency=$(awk -v s="$speedup" -v p="$p" -v b="$baseProcesses" 'BEGIN { printf "%.3f", s * b / p }')
+
+    echo "$mode,$program,$p,$(Field "$line" threads),$(Field "$line" size),$(Field "$line" mean),$(Field "$line" stddev),$gflops,$(Field "$line" gbs),$speedup,$efficiency,$check"
+    if [ "$check" = "failed" ]; then failed=1; fi
+done
+
+exit $failed
@@ -0,0 +1,121 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <mpich/mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//repeated measurements of parallel part of labs
+//every repetition is started after barrier, its time is the time of the slowest process
+//first warmup repetitions are not counted
+//result is printed as one line "Benchmark: key=value ..." for scripts of scaling sweeps
+
+struct BenchOptions {
+    int warmup; //repetitions before measurement
+    int repeats; //measured repetitions
+};
+
+struct BenchStats {
+    int count;
+    double mean, stddev, min, max; //seconds
+};
+
+struct Benchmark {
+    BenchOptions options;
+    double* times; //times of measured repetitions (only on process 0)
+    int done; //repetitions done (including warmup)
+};
+
+static inline void InitBenchmark(Benchmark& bench, int warmup, int repeats) {
+    bench.options.warmup = (warmup > 0) ? warmup : 0;
+    bench.options.repeats = (repeats > 0) ? repeats : 1;
+    bench.times = new double[bench.options.repeats];
+    bench.done = 0;
+}
+
+static inline int RepetitionsCount(const Benchmark& bench) {
+    return bench.options.warmup + bench.options.repeats;
+}
+
+//starts repetition (collective)
+static inline double StartRepetition(MPI_Comm comm) {
+    MPI_Barrier(comm);
+    return MPI_Wtime();
+}
+
+//finishes repetition started at tStart (collective), returns its time on process 0
+static inline double StopRepetition(Benchmark& bench, double tStart, MPI_Comm comm) {
+    double local = MPI_Wtime() - tStart, slowest = 0;
+    MPI_Reduce(&local, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    if (bench.done >= bench.options.warmup) {
+        bench.times[bench.done - bench.options.warmup] = slowest;
+    }
+    bench.done++;
+    return slowest;
+}
+
+static inline BenchStats ComputeStats(const Benchmark& bench) {
+    BenchStats stats;
+    stats.count = bench.done - bench.options.warmup;
+    stats.mean = stats.stddev = stats.min = stats.max = 0;
+    if (stats.count <= 0) return stats;
+
+    stats.min = stats.max = bench.times[0];
+    for (int i = 0; i < stats.count; i++) {
+        stats.mean += bench.times[i];
+        if (bench.times[i] < stats.min) stats.min = bench.times[i];
+        if (bench.times[i] > stats.max) stats.max = bench.times[i];
+    }
+    stats.mean /= stats.count;
+
+    for (int i = 0; i < stats.count; i++) {
+        stats.stddev += (bench.times[i] - stats.mean) * (bench.times[i] - stats.mean);
+    }
+    stats.stddev = (stats.count > 1) ? sqrt(stats.stddev / (stats.count - 1)) : 0;
+    return stats;
+}
+
+//threads of OpenMP need at least MPI_THREAD_FUNNELED (only main thread calls MPI),
+//with smaller support process works with one thread
+static inline void CheckThreadSupport(int threadSupport, int mpi_rank) {
+    if (threadSupport >= MPI_THREAD_FUNNELED) return;
+    if (mpi_rank == 0) printf("\nMPI doesn't support MPI_THREAD_FUNNELED, calculations use one thread\n");
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+}
+
+static inline int ThreadsCount() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+//prints result of benchmark, flops and bytes are work of one repetition
+//check is 1 if result is equal to linear method, 0 if not, -1 if it wasn't checked
+static inline void PrintBenchmark(const Benchmark& bench, const char* program, const char* variant, long size, int processes, double flops, double bytes, int check) {
+    BenchStats stats = ComputeStats(bench);
+    double gflops = (stats.mean > 0) ? flops / stats.mean / 1e9 : 0;
+    double gbs = (stats.mean > 0) ? bytes / stats.mean / 1e9 : 0;
+    const char* checkName = (check < 0) ? "skipped" : ((check > 0) ? "ok" : "failed");
+
+    printf("\nBenchmark: program=%s variant=%s size=%ld processes=%d threads=%d warmup=%d repeats=%d"
+            " mean=%.6f stddev=%.6f min=%.6f max=%.6f gflops=%.4f gbs=%.4f check=%s",
+            program, variant, size, processes, ThreadsCount(), bench.options.warmup, stats.count,
+            stats.mean, stats.stddev, stats.min, stats.max, gflops, gbs, checkName);
+}
+
+static inline void FreeBenchmark(Benchmark& bench) {
+    delete[] bench.times;
+    bench.times = NULL;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,191 @@
+#ifndef BINFILE_H
+#define BINFILE_H
+
+#include <mpich/mpi.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "element.h"
+
+//binary files with arrays and matrices for labs
+//file is header (32 bytes) and raw elements in native byte order, row after row
+//type of elements is written in header (DataTypes), functions are templates of type of elements
+//all processes read and write their parts of file directly with MPI-IO
+
+//flags of file
+enum FileFlags {
+    flagTransposed = 1 //matrix is stored transposed
+};
+
+struct FileHeader {
+    char magic[4]; //"MPIL"
+    int32_t dtype; //type of elements (DataTypes)
+    int32_t dims; //1 for arrays, 2 for matrices
+    int32_t flags; //FileFlags
+    int64_t shape[2]; //count of elements for arrays, rows and columns for matrices
+};
+
+const char fileMagic[4] = {'M', 'P', 'I', 'L'};
+
+static inline long ElementsCount(const FileHeader& header) {
+    return (header.dims == 1) ? header.shape[0] : header.shape[0] * header.shape[1];
+}
+
+static inline bool FileExists(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return false;
+    fclose(file);
+    return true;
+}
+
+static inline void InitHeader(FileHeader& header, int dims, long rows, long cols, int flags, int dtype) {
+    memcpy(header.magic, fileMagic, 4);
+    header.dtype = dtype;
+    header.dims = dims;
+    header.flags = flags;
+    header.shape[0] = rows;
+    header.shape[1] = (dims == 1) ? 1 : cols;
+}
+
+//writes header and elements to new file (only by one process)
+template <typename T>
+static inline bool WriteDataFile(const char* path, int dims, long rows, long cols, int flags, const T* data) {
+    FileHeader header;
+    InitHeader(header, dims, rows, cols, flags, Element<T>::dtype);
+
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_SELF, (char*) path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        return false;
+    }
+    MPI_File_set_size(file, 0);
+    MPI_File_write_at(file, 0, &header, sizeof (header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    //write by parts, count of MPI functions is int
+    long count = ElementsCount(header);
+    const long part = 1 << 28;
+    for (long i = 0; i < count; i += part) {
+        int n = (count - i < part) ? (int) (count - i) : (int) part;
+        MPI_File_write_at(file, sizeof (header) + i * sizeof (T), (void*) (data + i), n, Element<T>::Type(), MPI_STATUS_IGNORE);
+    }
+
+    MPI_File_close(&file);
+    return true;
+}
+
+//opens file with elements of type dtype by all processes of comm and reads its header
+static inline bool OpenDataFile(const char* path, MPI_Comm comm, MPI_File& file, FileHeader& header, int dtype) {
+    if (MPI_File_open(comm, (char*) path, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        return false;
+    }
+    MPI_File_read_at_all(file, 0, &header, sizeof (header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    if (memcmp(header.magic, fileMagic, 4) != 0 || header.dtype != dtype) {
+        MPI_File_close(&file);
+        return false;
+    }
+    return true;
+}
+
+//reads count elements of array starting from element offset (collective)
+template <typename T>
+static inline void ReadArraySlice(MPI_File file, long offset, int count, T* dst) {
+    MPI_File_read_at_all(file, sizeof (FileHeader) + offset * sizeof (T), dst, count, Element<T>::Type(), MPI_STATUS_IGNORE);
+}
+
+//sets view of file to block of stored matrix, empty blocks get empty view
+static inline void SetBlockView(MPI_File file, const FileHeader& header, long row0, long col0, int rows, int cols, MPI_Datatype type) {
+    if (rows > 0 && cols > 0) {
+        int sizes[2] = {(int) header.shape[0], (int) header.shape[1]};
+        int subsizes[2] = {rows, cols};
+        int starts[2] = {(int) row0, (int) col0};
+        MPI_Datatype block;
+        MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, type, &block);
+        MPI_Type_commit(&block);
+        MPI_File_set_view(file, sizeof (FileHeader), type, block, (char*) "native", MPI_INFO_NULL);
+        MPI_Type_free(&block);
+    } else {
+        MPI_File_set_view(file, sizeof (FileHeader), type, type, (char*) "native", MPI_INFO_NULL);
+    }
+}
+
+//reads block rows x cols starting from (row0, col0) of matrix to dst with row length ld (collective)
+//if transposed, block is taken from transposed matrix
+//elements out of matrix are filled with zeros (for padded blocks)
+template <typename T>
+static inline void ReadMatrixBlock(MPI_File file, const FileHeader& header, bool transposed, long row0, long col0, int rows, int cols, T* dst, int ld) {
+    bool swap = transposed != ((header.flags & flagTransposed) != 0);
+    long matrixRows = swap ? header.shape[1] : header.shape[0];
+    long matrixCols = swap ? header.shape[0] : header.shape[1];
+
+    //part of block inside matrix
+    int inRows = (matrixRows - row0 < rows) ? (int) (matrixRows - row0) : rows;
+    int inCols = (matrixCols - col0 < cols) ? (int) (matrixCols - col0) : cols;
+    if (inRows < 0) inRows = 0;
+    if (inCols < 0) inCols = 0;
+
+    for (int i = 0; i < rows; i++) {
+        memset(dst + (long) i * ld, 0, cols * sizeof (T));
+    }
+
+    T* temp = new T[(long) inRows * inCols + 1];
+    if (swap) {
+        SetBlockView(file, header, col0, row0, inCols, inRows, Element<T>::Type());
+    } else {
+        SetBlockView(file, header, row0, col0, inRows, inCols, Element<T>::Type());
+    }
+    MPI_File_read_all(file, temp, inRows * inCols, Element<T>::Type(), MPI_STATUS_IGNORE);
+
+    for (int i = 0; i < inRows; i++) {
+        for (int j = 0; j < inCols; j++) {
+            dst[(long) i * ld + j] = swap ? temp[(long) j * inRows + i] : temp[(long) i * inCols + j];
+        }
+    }
+    delete[] temp;
+}
+
+//creates file for matrix rows x cols with elements of type dtype by all processes of comm (header is written by process 0)
+static inline bool CreateMatrixFile(const char* path, long rows, long cols, int dtype, MPI_Comm comm, MPI_File& file, FileHeader& header) {
+    InitHeader(header, 2, rows, cols, 0, dtype);
+
+    if (MPI_File_open(comm, (char*) path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        return false;
+    }
+    MPI_File_set_size(file, 0);
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank == 0) {
+        MPI_File_write_at(file, 0, &header, sizeof (header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    return true;
+}
+
+//writes block rows x cols starting from (row0, col0) from src with row length ld (collective)
+//elements out of matrix are skipped (for padded blocks)
+template <typename T>
+static inline void WriteMatrixBlock(MPI_File file, const FileHeader& header, long row0, long col0, int rows, int cols, const T* src, int ld) {
+    int inRows = (header.shape[0] - row0 < rows) ? (int) (header.shape[0] - row0) : rows;
+    int inCols = (header.shape[1] - col0 < cols) ? (int) (header.shape[1] - col0) : cols;
+    if (inRows < 0) inRows = 0;
+    if (inCols < 0) inCols = 0;
+
+    T* temp = new T[(long) inRows * inCols + 1];
+    for (int i = 0; i < inRows; i++) {
+        memcpy(temp + (long) i * inCols, src + (long) i * ld, inCols * sizeof (T));
+    }
+
+    SetBlockView(file, header, row0, col0, inRows, inCols, Element<T>::Type());
+    MPI_File_write_all(file, temp, inRows * inCols, Element<T>::Type(), MPI_STATUS_IGNORE);
+    delete[] temp;
+}
+
+//opened files of matrices for multiplication C = A * B
+//blocks of A and B are read from files instead of scattering from process 0
+//blocks of C are written to file instead of gathering to process 0
+struct MatrixFiles {
+    bool readInput, writeOutput;
+    MPI_File fileA, fileB, fileC;
+    FileHeader headerA, headerB, headerC;
+};
+
+#endif /* BINFILE_H */
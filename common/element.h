@@ -0,0 +1,180 @@
+#ifndef ELEMENT_H
+#define ELEMENT_H
+
+#include <mpich/mpi.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+//types of elements of arrays and matrices of labs
+//traits Element<T> give for every type its MPI datatype, code in data files and type of calculations (Acc)
+//fp16 and bf16 are only stored (half of bytes in memory, messages and files),
+//they are converted to float for calculations, so their sums are float
+//int32 is calculated in long, so sums of products of int32 don't overflow
+
+enum DataTypes {
+    dtypeInt32 = 0,
+    dtypeInt64 = 1,
+    dtypeFloat32 = 2,
+    dtypeFloat64 = 3,
+    dtypeFloat16 = 4,
+    dtypeBfloat16 = 5
+};
+
+const char* const dataTypeNames[] = {"int32", "int64", "float", "double", "fp16", "bf16"};
+
+//type by name from command line, -1 if there is no such type
+static inline int ParseDataType(const char* name) {
+    for (int dtype = dtypeInt32; dtype <= dtypeBfloat16; dtype++) {
+        if (strcmp(name, dataTypeNames[dtype]) == 0) return dtype;
+    }
+    return -1;
+}
+
+//IEEE half precision: sign, 5 bits of exponent, 10 bits of mantissa
+struct float16 {
+    uint16_t bits;
+};
+
+//upper half of float: sign, 8 bits of exponent, 7 bits of mantissa
+struct bfloat16 {
+    uint16_t bits;
+};
+
+static inline float HalfToFloat(uint16_t bits) {
+    uint32_t sign = (uint32_t) (bits & 0x8000) << 16;
+    uint32_t exponent = (bits >> 10) & 0x1F;
+    uint32_t mantissa = bits & 0x3FF;
+    uint32_t x;
+    if (exponent == 0x1F) {
+        x = sign | 0x7F800000 | (mantissa << 13); //infinity or NaN
+    } else if (exponent != 0) {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        //zero or subnormal number, mantissa * 2^-24
+        float value = mantissa * (1.0f / 16777216.0f);
+        memcpy(&x, &value, sizeof (x));
+        x |= sign;
+    }
+    float value;
+    memcpy(&value, &x, sizeof (value));
+    return value;
+}
+
+//rounds to nearest even, too big values become infinity
+static inline uint16_t FloatToHalf(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof (x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t mantissa = x & 0x7FFFFF;
+    int exponent = (int) ((x >> 23) & 0xFF);
+    if (exponent == 0xFF) return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+
+    exponent -= 112; //exponent of half
+    if (exponent >= 31) return sign | 0x7C00;
+
+    //subnormal numbers keep shifted mantissa with hidden bit
+    int shift = 13;
+    uint32_t half;
+    if (exponent <= 0) {
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        half = mantissa >> shift;
+    } else {
+        half = ((uint32_t) exponent << 10) | (mantissa >> shift);
+    }
+
+    //carry of rounding may go to exponent, it is correct
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) half++;
+    return sign | half;
+}
+
+static inline float Bfloat16ToFloat(uint16_t bits) {
+    uint32_t x = (uint32_t) bits << 16;
+    float value;
+    memcpy(&value, &x, sizeof (value));
+    return value;
+}
+
+//rounds to nearest even
+static inline uint16_t FloatToBfloat16(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof (x));
+    if ((x & 0x7FFFFFFF) > 0x7F800000) return (x >> 16) | 0x40; //NaN stays NaN
+    x += 0x7FFF + ((x >> 16) & 1);
+    return x >> 16;
+}
+
+//Tolerance is relative error of results calculated in different order (0 - results are equal)
+template <typename T> struct Element;
+
+template <> struct Element<int> {
+    typedef long Acc;
+    static const int dtype = dtypeInt32;
+    static MPI_Datatype Type() { return MPI_INT; }
+    static Acc ToAcc(int value) { return value; }
+    static int FromAcc(Acc value) { return value; }
+    static double Tolerance() { return 0; }
+};
+
+template <> struct Element<long> {
+    typedef long Acc;
+    static const int dtype = dtypeInt64;
+    static MPI_Datatype Type() { return MPI_LONG; }
+    static Acc ToAcc(long value) { return value; }
+    static long FromAcc(Acc value) { return value; }
+    static double Tolerance() { return 0; }
+};
+
+template <> struct Element<float> {
+    typedef float Acc;
+    static const int dtype = dtypeFloat32;
+    static MPI_Datatype Type() { return MPI_FLOAT; }
+    static Acc ToAcc(float value) { return value; }
+    static float FromAcc(Acc value) { return value; }
+    static double Tolerance() { return 1e-5; }
+};
+
+template <> struct Element<double> {
+    typedef double Acc;
+    static const int dtype = dtypeFloat64;
+    static MPI_Datatype Type() { return MPI_DOUBLE; }
+    static Acc ToAcc(double value) { return value; }
+    static double FromAcc(Acc value) { return value; }
+    static double Tolerance() { return 1e-12; }
+};
+
+template <> struct Element<float16> {
+    typedef float Acc;
+    static const int dtype = dtypeFloat16;
+    static MPI_Datatype Type() { return MPI_UINT16_T; }
+    static Acc ToAcc(float16 value) { return HalfToFloat(value.bits); }
+    static float16 FromAcc(Acc value) { float16 h = {FloatToHalf(value)}; return h; }
+    static double Tolerance() { return 1e-5; }
+};
+
+template <> struct Element<bfloat16> {
+    typedef float Acc;
+    static const int dtype = dtypeBfloat16;
+    static MPI_Datatype Type() { return MPI_UINT16_T; }
+    static Acc ToAcc(bfloat16 value) { return Bfloat16ToFloat(value.bits); }
+    static bfloat16 FromAcc(Acc value) { bfloat16 b = {FloatToBfloat16(value)}; return b; }
+    static double Tolerance() { return 1e-5; }
+};
+
+//compares arrays of results with tolerance of type of elements T
+template <typename T, typename A>
+static inline bool EqualElements(const A* a, const A* b, long count) {
+    double tolerance = Element<T>::Tolerance();
+    if (tolerance == 0) return memcmp(a, b, count * sizeof (A)) == 0;
+    for (long i = 0; i < count; i++) {
+        double difference = fabs((double) a[i] - (double) b[i]);
+        if (difference > tolerance * fabs((double) b[i]) + tolerance) return false;
+    }
+    return true;
+}
+
+#endif /* ELEMENT_H */
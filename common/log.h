@@ -0,0 +1,199 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <mpich/mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "metrics.h"
+
+//output of all processes without serialization of processes
+//every process appends records to its own buffer, buffer is written in one operation:
+//  ordered - Flush is collective, buffers are gathered to process 0 (MPI_Gatherv) and printed in rank order,
+//            or written to file in rank order (MPI_File_write_ordered)
+//  async   - for hot loops, buffer is written by process itself when it is big or old enough,
+//            records of processes are not ordered, file is written without waiting (MPI_File_iwrite_shared)
+//output goes to stdout or to file from environment variable MPI_LABS_LOG_FILE
+
+enum LogModes {
+    logOrdered,
+    logAsync
+};
+
+const int logAsyncChunk = 64 * 1024; //bytes of buffer written at once in async mode
+const double logAsyncPeriod = 1; //seconds, max age of records in buffer in async mode
+
+class Log {
+public:
+    Log();
+    void Open(MPI_Comm comm, LogModes mode); //collective
+    void Printf(const char* format, ...); //appends record to buffer of this process
+    void Flush(); //ordered: collective, async: writes buffer of this process
+    void Close(); //collective, writes the rest
+private:
+    void Append(const char* format, va_list args);
+    void WriteAsync();
+
+    MPI_Comm comm;
+    LogModes mode;
+    bool opened;
+    char* buffer;
+    long size, capacity;
+    double tFlush; //time of last write in async mode
+    MPI_File file;
+    bool toFile;
+    char* pending; //buffer written to file without waiting
+    long pendingCapacity;
+    MPI_Request request;
+};
+
+inline Log::Log() {
+    opened = false;
+    buffer = pending = NULL;
+    size = capacity = 0;
+    toFile = false;
+    request = MPI_REQUEST_NULL;
+}
+
+inline void Log::Open(MPI_Comm comm, LogModes mode) {
+    this->comm = comm;
+    this->mode = mode;
+    opened = true;
+    capacity = logAsyncChunk;
+    buffer = new char[capacity];
+    pendingCapacity = capacity;
+    pending = new char[pendingCapacity];
+    size = 0;
+    tFlush = MPI_Wtime();
+
+    const char* path = getenv("MPI_LABS_LOG_FILE");
+    toFile = path != NULL;
+    if (toFile) {
+        MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file);
+        MPI_File_set_size(file, 0);
+    }
+}
+
+inline void Log::Append(const char* format, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(buffer + size, capacity - size, format, copy);
+    va_end(copy);
+    if (length < 0) return;
+
+    //buffer grows, so record isn't cut
+    if (size + length + 1 > capacity) {
+        while (size + length + 1 > capacity) capacity *= 2;
+        char* grown = new char[capacity];
+        memcpy(grown, buffer, size);
+        delete[] buffer;
+        buffer = grown;
+        vsnprintf(buffer + size, capacity - size, format, args);
+    }
+    size += length;
+}
+
+inline void Log::Printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (!opened) {
+        //without Open records are printed at once
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+    Append(format, args);
+    va_end(args);
+
+    if (mode == logAsync && (size >= logAsyncChunk || MPI_Wtime() - tFlush >= logAsyncPeriod)) WriteAsync();
+}
+
+//writes buffer without waiting for other processes
+inline void Log::WriteAsync() {
+    tFlush = MPI_Wtime();
+    if (size == 0) return;
+
+    metrics.Start(phaseOutput);
+    if (toFile) {
+        //previous write must be done before its buffer is reused
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        if (size > pendingCapacity) {
+            delete[] pending;
+            pendingCapacity = capacity;
+            pending = new char[pendingCapacity];
+        }
+        memcpy(pending, buffer, size);
+        MPI_File_iwrite_shared(file, pending, size, MPI_CHAR, &request);
+        metrics.AddBytes(callFileWrite, size);
+    } else {
+        fwrite(buffer, 1, size, stdout);
+        fflush(stdout);
+    }
+    size = 0;
+    metrics.Stop(phaseOutput);
+}
+
+inline void Log::Flush() {
+    if (!opened) return;
+    if (mode == logAsync) {
+        WriteAsync();
+        return;
+    }
+
+    metrics.Start(phaseOutput);
+    if (toFile) {
+        MPI_File_write_ordered(file, buffer, size, MPI_CHAR, MPI_STATUS_IGNORE);
+        metrics.AddBytes(callFileWrite, size);
+    } else {
+        int mpi_rank, mpi_size;
+        MPI_Comm_rank(comm, &mpi_rank);
+        MPI_Comm_size(comm, &mpi_size);
+
+        //sizes of buffers, then buffers in rank order
+        int count = size;
+        int* counts = (mpi_rank == 0) ? new int[mpi_size] : NULL;
+        int* displs = (mpi_rank == 0) ? new int[mpi_size] : NULL;
+        MPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+        char* all = NULL;
+        long total = 0;
+        if (mpi_rank == 0) {
+            for (int i = 0; i < mpi_size; i++) {
+                displs[i] = total;
+                total += counts[i];
+            }
+            all = new char[total + 1];
+        }
+        MPI_Gatherv(buffer, count, MPI_CHAR, all, counts, displs, MPI_CHAR, 0, comm);
+        metrics.AddBytes(callGather, count);
+
+        if (mpi_rank == 0) {
+            fwrite(all, 1, total, stdout);
+            fflush(stdout);
+        }
+        delete[] all;
+        delete[] counts;
+        delete[] displs;
+    }
+    size = 0;
+    metrics.Stop(phaseOutput);
+}
+
+inline void Log::Close() {
+    if (!opened) return;
+
+    Flush();
+    if (toFile) {
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        MPI_File_close(&file);
+    }
+    delete[] buffer;
+    delete[] pending;
+    buffer = pending = NULL;
+    opened = false;
+}
+
+static Log logger;
+
+#endif /* LOG_H */
@@ -0,0 +1,169 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <mpich/mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//wall clock timers of phases of programs and counters of bytes moved by MPI calls
+//every process measures itself, results of all processes are reduced in Report
+//report format is set by environment variable MPI_LABS_METRICS (text, json or csv),
+//report goes to stdout or to file from MPI_LABS_METRICS_FILE
+
+enum Phases {
+    phaseGenerate = 0,
+    phaseIO,
+    phaseScatter,
+    phaseCompute,
+    phaseShift,
+    phaseBroadcast,
+    phaseGather,
+    phaseReduce,
+    phaseSend,
+    phaseReceive,
+    phaseOutput,
+    phaseLinear,
+    phasesCount
+};
+
+const char* const phaseNames[phasesCount] = {
+    "generate", "io", "scatter", "compute", "shift", "broadcast", "gather", "reduce", "send", "receive", "output", "linear"
+};
+
+enum MpiCalls {
+    callScatter = 0,
+    callGather,
+    callBcast,
+    callReduce,
+    callSendrecv,
+    callSend,
+    callRecv,
+    callFileRead,
+    callFileWrite,
+    callAllgather,
+    callAlltoall,
+    callPut,
+    callGet,
+    callsCount
+};
+
+const char* const callNames[callsCount] = {
+    "scatter", "gather", "bcast", "reduce", "sendrecv", "send", "recv", "file_read", "file_write", "allgather", "alltoall", "put", "get"
+};
+
+class Metrics {
+public:
+    Metrics();
+    void Start(int phase); //start interval of phase
+    double Stop(int phase); //stop interval of phase, returns its duration
+    double Total(int phase); //time of all intervals of phase
+    void AddBytes(int call, long bytes); //bytes of local buffer passed to MPI call
+    void Report(const char* program, MPI_Comm comm); //collective, prints on process 0
+private:
+    double started[phasesCount];
+    double total[phasesCount];
+    long calls[callsCount];
+    long bytes[callsCount];
+};
+
+inline Metrics::Metrics() {
+    memset(started, 0, sizeof (started));
+    memset(total, 0, sizeof (total));
+    memset(calls, 0, sizeof (calls));
+    memset(bytes, 0, sizeof (bytes));
+}
+
+inline void Metrics::Start(int phase) {
+    started[phase] = MPI_Wtime();
+}
+
+inline double Metrics::Stop(int phase) {
+    double duration = MPI_Wtime() - started[phase];
+    total[phase] += duration;
+    return duration;
+}
+
+inline double Metrics::Total(int phase) {
+    return total[phase];
+}
+
+inline void Metrics::AddBytes(int call, long bytes) {
+    calls[call]++;
+    this->bytes[call] += bytes;
+}
+
+inline void Metrics::Report(const char* program, MPI_Comm comm) {
+    const char* format = getenv("MPI_LABS_METRICS");
+    if (format == NULL) return;
+
+    int mpi_rank, mpi_size;
+    MPI_Comm_rank(comm, &mpi_rank);
+    MPI_Comm_size(comm, &mpi_size);
+
+    //min, max and average time of phases between processes
+    double minTime[phasesCount], maxTime[phasesCount], sumTime[phasesCount];
+    long sumCalls[callsCount], sumBytes[callsCount];
+    MPI_Reduce(total, minTime, phasesCount, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(total, maxTime, phasesCount, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(total, sumTime, phasesCount, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(calls, sumCalls, callsCount, MPI_LONG, MPI_SUM, 0, comm);
+    MPI_Reduce(bytes, sumBytes, callsCount, MPI_LONG, MPI_SUM, 0, comm);
+
+    if (mpi_rank != 0) return;
+
+    const char* path = getenv("MPI_LABS_METRICS_FILE");
+    FILE* out = (path != NULL) ? fopen(path, "a") : stdout;
+    if (out == NULL) return;
+
+    bool json = strcmp(format, "json") == 0;
+    bool csv = strcmp(format, "csv") == 0;
+
+    if (json) {
+        fprintf(out, "{\"program\": \"%s\", \"processes\": %d, \"phases\": {", program, mpi_size);
+    } else if (csv) {
+        fprintf(out, "program,processes,kind,name,min,max,avg,count,bytes\n");
+    } else {
+        fprintf(out, "\n=================\nMetrics of %s (%d processes):", program, mpi_size);
+    }
+
+    bool first = true;
+    for (int i = 0; i < phasesCount; i++) {
+        if (maxTime[i] == 0) continue;
+        double avgTime = sumTime[i] / mpi_size;
+        if (json) {
+            fprintf(out, "%s\"%s\": {\"min\": %.6f, \"max\": %.6f, \"avg\": %.6f}", first ? "" : ", ", phaseNames[i], minTime[i], maxTime[i], avgTime);
+        } else if (csv) {
+            fprintf(out, "%s,%d,time,%s,%.6f,%.6f,%.6f,,\n", program, mpi_size, phaseNames[i], minTime[i], maxTime[i], avgTime);
+        } else {
+            fprintf(out, "\n%-10s min %.4fs max %.4fs avg %.4fs", phaseNames[i], minTime[i], maxTime[i], avgTime);
+        }
+        first = false;
+    }
+
+    if (json) fprintf(out, "}, \"calls\": {");
+    first = true;
+    for (int i = 0; i < callsCount; i++) {
+        if (sumCalls[i] == 0) continue;
+        if (json) {
+            fprintf(out, "%s\"%s\": {\"count\": %ld, \"bytes\": %ld}", first ? "" : ", ", callNames[i], sumCalls[i], sumBytes[i]);
+        } else if (csv) {
+            fprintf(out, "%s,%d,calls,%s,,,,%ld,%ld\n", program, mpi_size, callNames[i], sumCalls[i], sumBytes[i]);
+        } else {
+            fprintf(out, "\n%-10s calls %ld bytes %ld", callNames[i], sumCalls[i], sumBytes[i]);
+        }
+        first = false;
+    }
+
+    if (json) {
+        fprintf(out, "}}\n");
+    } else if (!csv) {
+        fprintf(out, "\n=================\n");
+    }
+
+    if (out != stdout) fclose(out);
+}
+
+static Metrics metrics; //metrics of this process
+
+#endif /* METRICS_H */